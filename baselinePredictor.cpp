@@ -0,0 +1,80 @@
+#include "baselinePredictor.h"
+#include "threadHandler.h"
+
+#include <algorithm>
+
+BaselinePredictor::BaselinePredictor() : globalMean(0.0f) {}
+
+void BaselinePredictor::fit(const CompactStore& movieStore, const CompactStore& userStore, int iterations,
+                            float userRegularization, float movieRegularization) {
+    this->movieStore = movieStore;
+    this->userStore = userStore;
+    size_t numMovies = movieStore.getRowCount();
+    size_t numUsers = userStore.getRowCount();
+    movieBiases.assign(numMovies, 0.0f);
+    userBiases.assign(numUsers, 0.0f);
+
+    double sum = 0.0;
+    for (size_t m = 0; m < numMovies; ++m) sum += static_cast<double>(movieStore.getRowAverage(m)) * movieStore.getRowLength(m);
+    globalMean = movieStore.getEntryCount() > 0 ? static_cast<float>(sum / movieStore.getEntryCount()) : 0.0f;
+
+    ThreadHandler th;
+    //Fits the biases of the rows of store, holding the biases of the other side fixed.
+    auto fitSide = [&](const CompactStore& store, const CompactStore& other, const std::vector<float>& otherBiases,
+                       std::vector<float>& biases, float regularization) {
+        auto fitChunk = [&](size_t start, size_t end) {
+            for (size_t row = start; row < end; ++row) {
+                float residualSum = 0.0f;
+                CompactStore::Cursor cursor = store.getCursor(row);
+                while (cursor.next()) {
+                    long otherRow = other.findRow(cursor.column());
+                    float otherBias = (otherRow >= 0) ? otherBiases[otherRow] : 0.0f;
+                    residualSum += cursor.rating() - globalMean - otherBias;
+                }
+                biases[row] = residualSum / (regularization + store.getRowLength(row));
+            }
+        };
+        th.runParallel(fitChunk, store.getRowCount());
+    };
+
+    for (int i = 0; i < iterations; ++i) {
+        fitSide(movieStore, userStore, userBiases, movieBiases, movieRegularization);
+        fitSide(userStore, movieStore, movieBiases, userBiases, userRegularization);
+    }
+}
+
+float BaselinePredictor::estimate(int userId, int movieId) const {
+    long userRow = userStore.findRow(userId);
+    long movieRow = movieStore.findRow(movieId);
+    float value = globalMean;
+    if (userRow >= 0) value += userBiases[userRow];
+    if (movieRow >= 0) value += movieBiases[movieRow];
+    return value;
+}
+
+float BaselinePredictor::predict(int userId, int movieId) const {
+    return std::min(std::max(estimate(userId, movieId), 0.0f), 5.0f);
+}
+
+float BaselinePredictor::getGlobalMean() const {
+    return globalMean;
+}
+
+float BaselinePredictor::getMovieBias(size_t movieRow) const {
+    return movieBiases[movieRow];
+}
+
+float BaselinePredictor::getUserBias(size_t userRow) const {
+    return userBiases[userRow];
+}
+
+MemoryUsage BaselinePredictor::getMemoryUsage() const {
+    MemoryUsage usage;
+    usage.payloadBytes = (movieBiases.size() + userBiases.size()) * sizeof(float);
+    usage.overheadBytes = (movieBiases.capacity() + userBiases.capacity()) * sizeof(float) - usage.payloadBytes;
+    return usage;
+}
+
+bool BaselinePredictor::isFitted() const {
+    return !movieBiases.empty() || !userBiases.empty();
+}
@@ -0,0 +1,77 @@
+#ifndef BASELINEPREDICTOR_H
+#define BASELINEPREDICTOR_H
+
+#include "compactStore.h"
+
+#include <algorithm>
+#include <vector>
+
+//How neighborhood predictions use the baseline predictor.
+enum class BaselineMode {
+    Off,      //No baseline, unpredictable pairs fall back to the average rating.
+    Fallback, //Unpredictable pairs fall back to the baseline estimate.
+    Residual  //Neighbors are averaged on their residuals from the baseline, which is also the fallback.
+};
+
+/* Finishes a neighborhood prediction from the weighted ratings (or residuals) of its neighbors, the same way for
+every predictor. Off: the weighted average, or average() without neighbors. Fallback: the weighted average, or
+estimate() without neighbors. Residual: estimate() plus the weighted average. Both baseline modes clamp to [0, 5].
+estimate and average are callables, so they are only computed when they are used. */
+template <typename Estimate, typename Average>
+float finishPrediction(BaselineMode mode, float weightedSum, float weightSum, const Estimate& estimate, const Average& average) {
+    if (mode == BaselineMode::Off) return weightSum > 0.0f ? weightedSum / weightSum : average();
+    float prediction;
+    if (weightSum <= 0.0f) prediction = estimate();
+    else if (mode == BaselineMode::Residual) prediction = estimate() + weightedSum / weightSum;
+    else prediction = weightedSum / weightSum;
+    return std::min(std::max(prediction, 0.0f), 5.0f);
+}
+
+/*
+ * Baseline estimator b(u, m) = mean + userBias[u] + movieBias[m].
+ *
+ * Biases are regularized averages of the residuals, fitted with a few alternating passes
+ * (all movie biases in parallel, then all user biases in parallel). They are stored in dense arrays
+ * indexed by the rows of the stores the predictor was fitted on: an estimate by row is two array reads,
+ * an estimate by id first finds the two rows with binary searches.
+ */
+class BaselinePredictor {
+public:
+	//Constructor. An unfitted predictor estimates 0 biases around a 0 mean.
+    BaselinePredictor();
+
+    /* Fits the biases. movieStore and userStore must hold the same ratings with movie and user rows.
+    Larger regularization values pull the biases of rarely rated entities towards 0. */
+    void fit(const CompactStore& movieStore, const CompactStore& userStore, int iterations = 3,
+             float userRegularization = 10.0f, float movieRegularization = 25.0f);
+
+    //Returns the estimate for a user and a movie. Unknown ids get a 0 bias.
+    float estimate(int userId, int movieId) const;
+
+    //Returns the estimate for a user and a movie, clamped between 0 and 5.
+    float predict(int userId, int movieId) const;
+
+    //Returns the mean of all ratings.
+    float getGlobalMean() const;
+
+    //Returns the bias of a row of the movie store the predictor was fitted on.
+    float getMovieBias(size_t movieRow) const;
+
+    //Returns the bias of a row of the user store the predictor was fitted on.
+    float getUserBias(size_t userRow) const;
+
+    //Returns true once fit() has run.
+    bool isFitted() const;
+
+    //Returns the bytes of the bias arrays. The stores are shared with the model and not counted.
+    MemoryUsage getMemoryUsage() const;
+
+private:
+    float globalMean;
+    CompactStore movieStore;       //Movie rows, used to map movie ids to movieBiases.
+    CompactStore userStore;        //User rows, used to map user ids to userBiases.
+    std::vector<float> movieBiases; //Bias of every movie row.
+    std::vector<float> userBiases;  //Bias of every user row.
+};
+
+#endif // BASELINEPREDICTOR_H
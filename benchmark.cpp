@@ -0,0 +1,94 @@
+#include "benchmark.h"
+#include "perfCounter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+
+//Runs a neighbor list build once and prints its runtime and cache misses.
+static CompactNeighbors measure(const std::string& name, const std::function<CompactNeighbors()>& build) {
+    PerfCounter counter;
+    auto timerStart = std::chrono::high_resolution_clock::now(); //Timer: Start.
+    counter.start();
+    CompactNeighbors neighbors = build();
+    uint64_t misses = counter.stop();
+    auto timerEnd = std::chrono::high_resolution_clock::now(); //Timer: End.
+    std::chrono::duration<double> runTime = timerEnd - timerStart;
+
+    std::cout << name << " runtime: " << runTime.count() << " seconds, cache-misses: ";
+    if (counter.isAvailable()) std::cout << misses << "\n";
+    else std::cout << "n/a\n";
+    return neighbors;
+}
+
+//Runs a prediction pass repeats times and prints its runtime per prediction.
+static void measurePredictions(const std::string& name, int repeats, size_t numPredictions, const std::function<void()>& pass) {
+    auto timerStart = std::chrono::high_resolution_clock::now(); //Timer: Start.
+    for (int r = 0; r < repeats; ++r) pass();
+    auto timerEnd = std::chrono::high_resolution_clock::now(); //Timer: End.
+    std::chrono::duration<double> runTime = timerEnd - timerStart;
+    std::cout << name << " runtime: " << runTime.count() << " seconds, "
+              << runTime.count() * 1e9 / (static_cast<double>(repeats) * numPredictions) << " ns/prediction\n";
+}
+
+void Benchmark::ibcfAggregation(const CompactModel& model, const CompactStore& testStore, int repeats) {
+    if (!model.isMovieBased()) return;
+    std::vector<std::vector<int>> movies(testStore.getRowCount());
+    std::vector<float> ratings;
+    size_t numPredictions = 0;
+    for (size_t u = 0; u < testStore.getRowCount(); ++u) {
+        testStore.decodeRow(u, movies[u], ratings);
+        numPredictions += movies[u].size();
+    }
+    std::cout << "test-users: " << testStore.getRowCount() << " predictions: " << numPredictions << " repeats: " << repeats << "\n";
+    if (numPredictions == 0) return;
+
+    std::vector<float> batched, single, prediction;
+    measurePredictions("batched-aggregation", repeats, numPredictions, [&]() {
+        batched.clear();
+        for (size_t u = 0; u < testStore.getRowCount(); ++u) {
+            model.predictUser(testStore.getRowId(u), movies[u], prediction);
+            batched.insert(batched.end(), prediction.begin(), prediction.end());
+        }
+    });
+    measurePredictions("per-neighbor-search", repeats, numPredictions, [&]() {
+        single.clear();
+        for (size_t u = 0; u < testStore.getRowCount(); ++u) {
+            std::vector<int> user(1, testStore.getRowId(u));
+            for (int movieId : movies[u]) {
+                model.predictMovie(movieId, user, prediction);
+                single.push_back(prediction[0]);
+            }
+        }
+    });
+
+    //Both paths must predict the same ratings, up to the summation order.
+    float maxDifference = 0.0f;
+    for (size_t p = 0; p < batched.size(); ++p) maxDifference = std::max(maxDifference, std::fabs(batched[p] - single[p]));
+    if (maxDifference > 1e-4f) std::cerr << "err: batched-and-per-neighbor-predictions-differ-by-" << maxDifference << ".\n";
+}
+
+void Benchmark::similarityTraversal(const CompactStore& store, int k, SimilarityCodec codec, size_t tileRows,
+                                    const SimilarityOptions& options) {
+    Similarity sm;
+    if (tileRows == 0) tileRows = sm.tileRowCount(store);
+
+    std::cout << "rows: " << store.getRowCount() << " entries: " << store.getEntryCount()
+              << " store-bytes: " << store.getByteSize() << " tile-rows: " << tileRows << "\n";
+
+    CompactNeighbors untiled = measure("untiled", [&]() { return sm.neighborLists(store, k, codec, options); });
+    CompactNeighbors tiled = measure("tiled", [&]() { return sm.tiledNeighborLists(store, k, codec, tileRows, options); });
+
+    //Both traversals must select the same neighbors.
+    size_t mismatches = 0;
+    for (size_t row = 0; row < store.getRowCount(); ++row) {
+        if (untiled.getCount(row) != tiled.getCount(row)) { mismatches++; continue; }
+        for (size_t n = 0; n < untiled.getCount(row); ++n) {
+            if (untiled.getNeighbor(row, n) != tiled.getNeighbor(row, n)) { mismatches++; break; }
+        }
+    }
+    if (mismatches > 0) std::cerr << "err: tiled-and-untiled-neighbors-differ-in-" << mismatches << "-rows.\n";
+}
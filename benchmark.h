@@ -0,0 +1,22 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "compactStore.h"
+#include "compactModel.h"
+#include "similarity.h"
+
+class Benchmark {
+public:
+    /* Builds the top-k neighbor lists of the rows of the store with the untiled and the tiled traversal, with the
+    given codec and options, and prints the runtime and the cache misses (when perf counters are available) of both.
+    tileRows = 0: Tile size is picked from the L2 cache size. */
+    void similarityTraversal(const CompactStore& store, int k, SimilarityCodec codec = SimilarityCodec::Short, size_t tileRows = 0,
+                             const SimilarityOptions& options = SimilarityOptions());
+
+    /* Predicts the test store (user rows) with an IBCF model repeats times, once with the batched aggregation
+    kernel of CompactModel::predictUser() and once one pair at a time with the per-neighbor search of
+    CompactModel::predictMovie(), and prints the runtime of both. */
+    void ibcfAggregation(const CompactModel& model, const CompactStore& testStore, int repeats = 20);
+};
+
+#endif // BENCHMARK_H
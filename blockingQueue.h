@@ -0,0 +1,57 @@
+#ifndef BLOCKINGQUEUE_H
+#define BLOCKINGQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Thread-safe FIFO queue connecting the stages of a pipeline.
+ * push() blocks while a bounded queue is full, pop() blocks while the queue is empty.
+ * After close() pushes are rejected and pop() drains the remaining items, then returns false.
+ */
+template <typename T>
+class BlockingQueue {
+public:
+	//Constructor. capacity = 0: Unbounded.
+    explicit BlockingQueue(size_t capacity = 0) : capacity(capacity), closed(false) {}
+
+    //Adds an item. Returns false if the queue is closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return closed || capacity == 0 || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    //Removes the oldest item into item. Returns false once the queue is closed and empty.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    //Closes the queue and wakes up every waiting thread.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+#endif // BLOCKINGQUEUE_H
@@ -0,0 +1,190 @@
+#include "compactModel.h"
+#include "neighborAggregator.h"
+
+#include <algorithm>
+#include <iterator>
+
+CompactModel::CompactModel(const CompactStore& rowStore, const CompactStore& columnStore, const CompactNeighbors& neighbors)
+    : rowStore(rowStore), columnStore(columnStore), neighbors(neighbors), baselineMode(BaselineMode::Off) {}
+
+void CompactModel::setBaseline(const BaselinePredictor& baseline, BaselineMode mode) {
+    this->baseline = baseline;
+    baselineMode = baseline.isFitted() ? mode : BaselineMode::Off;
+}
+
+float CompactModel::rowBias(long row) const {
+    if (row < 0) return 0.0f;
+    return isMovieBased() ? baseline.getMovieBias(row) : baseline.getUserBias(row);
+}
+
+float CompactModel::columnBias(long row) const {
+    if (row < 0) return 0.0f;
+    return isMovieBased() ? baseline.getUserBias(row) : baseline.getMovieBias(row);
+}
+
+float CompactModel::lookupBase(long lookupRow) const {
+    if (baselineMode == BaselineMode::Off) return 0.0f;
+    return baseline.getGlobalMean() + columnBias(lookupRow);
+}
+
+float CompactModel::finishPrediction(long row, float base, float weightedSum, float similaritySum) const {
+    return ::finishPrediction(baselineMode, weightedSum, similaritySum, [&]() { return base + rowBias(row); },
+                              [&]() { return row >= 0 ? rowStore.getRowAverage(row) : -1.0f; });
+}
+
+float CompactModel::predictRow(long row, long lookupRow, const std::vector<int>& columns, const std::vector<float>& ratings) const {
+    bool residual = (baselineMode == BaselineMode::Residual);
+    float base = lookupBase(lookupRow); //Baseline of the pair without the row bias.
+    if (row < 0) return finishPrediction(row, base, 0.0f, 0.0f);
+
+    float weightedSum = 0.0f;
+    float similaritySum = 0.0f;
+    for (size_t n = 0; n < neighbors.getCount(row); ++n) {
+        uint32_t neighborRow = neighbors.getNeighbor(row, n);
+        int neighborId = rowStore.getRowId(neighborRow);
+        auto ci = std::lower_bound(columns.begin(), columns.end(), neighborId); //ci: Column iterator
+        if (ci == columns.end() || *ci != neighborId) continue;
+
+        float similarity = neighbors.getSimilarity(row, n);
+        float rating = ratings[ci - columns.begin()];
+        if (residual) rating -= base + rowBias(neighborRow);
+        weightedSum += similarity * rating;
+        similaritySum += similarity;
+    }
+    return finishPrediction(row, base, weightedSum, similaritySum);
+}
+
+void CompactModel::predictUser(int userId, const std::vector<int>& movieIds, std::vector<float>& predictions) const {
+    predictions.clear();
+    std::vector<int> columns;
+    std::vector<float> ratings;
+
+    if (isMovieBased()) {
+        /* IBCF: the ratings of the user are loaded into the aggregator once, by movie row, and all the movies are
+        aggregated in one call. Every neighbor is then a direct probe instead of a search in the user ratings. */
+        thread_local NeighborAggregator aggregator; //Scratch arrays, one per thread so the model stays const.
+        long userRow = columnStore.findRow(userId);
+        float base = lookupBase(userRow);
+        std::vector<uint32_t> ratedRows;
+        if (userRow >= 0) columnStore.decodeRow(userRow, columns, ratings);
+        for (size_t r = 0; r < columns.size(); ++r) {
+            long movieRow = rowStore.findRow(columns[r]);
+            if (movieRow < 0) continue;
+            ratedRows.push_back(static_cast<uint32_t>(movieRow));
+            ratings[ratedRows.size() - 1] = (baselineMode == BaselineMode::Residual) ? ratings[r] - base - rowBias(movieRow) : ratings[r];
+        }
+        ratings.resize(ratedRows.size());
+
+        std::vector<long> movieRows;
+        std::vector<float> weightedSums, similaritySums;
+        for (int movieId : movieIds) movieRows.push_back(rowStore.findRow(movieId));
+        aggregator.setUser(rowStore.getRowCount(), ratedRows, ratings);
+        aggregator.aggregate(neighbors, movieRows, weightedSums, similaritySums);
+        aggregator.clearUser();
+        for (size_t m = 0; m < movieRows.size(); ++m) {
+            predictions.push_back(finishPrediction(movieRows[m], base, weightedSums[m], similaritySums[m]));
+        }
+    } else {
+        //UBCF: the neighbors of the user are shared, the ratings of every movie are decoded.
+        long userRow = rowStore.findRow(userId);
+        for (int movieId : movieIds) {
+            long movieRow = columnStore.findRow(movieId);
+            if (movieRow >= 0) columnStore.decodeRow(movieRow, columns, ratings);
+            else { columns.clear(); ratings.clear(); }
+            predictions.push_back(predictRow(userRow, movieRow, columns, ratings));
+        }
+    }
+}
+
+void CompactModel::predictMovie(int movieId, const std::vector<int>& userIds, std::vector<float>& predictions) const {
+    predictions.clear();
+    std::vector<int> columns;
+    std::vector<float> ratings;
+
+    if (isMovieBased()) {
+        //IBCF: the neighbors of the movie are shared, the ratings of every user are decoded.
+        long movieRow = rowStore.findRow(movieId);
+        for (int userId : userIds) {
+            long userRow = columnStore.findRow(userId);
+            if (userRow >= 0) columnStore.decodeRow(userRow, columns, ratings);
+            else { columns.clear(); ratings.clear(); }
+            predictions.push_back(predictRow(movieRow, userRow, columns, ratings));
+        }
+    } else {
+        //UBCF: the ratings of the movie are decoded once and shared by all the users.
+        long movieRow = columnStore.findRow(movieId);
+        if (movieRow >= 0) columnStore.decodeRow(movieRow, columns, ratings);
+        for (int userId : userIds) predictions.push_back(predictRow(rowStore.findRow(userId), movieRow, columns, ratings));
+    }
+}
+
+float CompactModel::predict(int userId, int movieId) const {
+    std::vector<float> predictions;
+    predictUser(userId, std::vector<int>(1, movieId), predictions);
+    return predictions[0];
+}
+
+void CompactModel::recommend(int userId, size_t count, std::vector<std::pair<int, float>>& recommendations) const {
+    recommendations.clear();
+    const CompactStore& userStore = isMovieBased() ? columnStore : rowStore;
+    const CompactStore& movieStore = isMovieBased() ? rowStore : columnStore;
+    long userRow = userStore.findRow(userId);
+    if (userRow < 0 || count == 0) return;
+
+    std::vector<int> rated;
+    std::vector<float> ratings;
+    userStore.decodeRow(userRow, rated, ratings);
+    std::vector<int> candidates;
+    if (isMovieBased()) {
+        for (size_t m = 0; m < movieStore.getRowCount(); ++m) candidates.push_back(movieStore.getRowId(m));
+    } else {
+        for (size_t n = 0; n < neighbors.getCount(userRow); ++n) {
+            CompactStore::Cursor cursor = rowStore.getCursor(neighbors.getNeighbor(userRow, n));
+            while (cursor.next()) candidates.push_back(cursor.column());
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+    std::vector<int> unrated;
+    std::set_difference(candidates.begin(), candidates.end(), rated.begin(), rated.end(), std::back_inserter(unrated));
+
+    std::vector<float> predictions;
+    predictUser(userId, unrated, predictions);
+    for (size_t m = 0; m < unrated.size(); ++m) {
+        if (predictions[m] >= 0.0f) recommendations.push_back({ unrated[m], predictions[m] });
+    }
+    rankRecommendations(recommendations, count);
+}
+
+void CompactModel::rankRecommendations(std::vector<std::pair<int, float>>& recommendations, size_t count) {
+    auto better = [](const std::pair<int, float>& a, const std::pair<int, float>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+    count = std::min(count, recommendations.size());
+    std::partial_sort(recommendations.begin(), recommendations.begin() + count, recommendations.end(), better);
+    recommendations.resize(count);
+}
+
+MemoryUsage CompactModel::getMemoryUsage() const {
+    MemoryUsage usage = rowStore.getMemoryUsage();
+    usage += columnStore.getMemoryUsage();
+    usage += neighbors.getMemoryUsage();
+    usage += baseline.getMemoryUsage();
+    return usage;
+}
+
+bool CompactModel::isMovieBased() const {
+    return rowStore.isMovieBased();
+}
+
+const CompactStore& CompactModel::getRowStore() const {
+    return rowStore;
+}
+
+const CompactStore& CompactModel::getColumnStore() const {
+    return columnStore;
+}
+
+const CompactNeighbors& CompactModel::getNeighbors() const {
+    return neighbors;
+}
@@ -0,0 +1,80 @@
+#ifndef COMPACTMODEL_H
+#define COMPACTMODEL_H
+
+#include "compactStore.h"
+#include "compactNeighbors.h"
+#include "baselinePredictor.h"
+
+#include <utility>
+#include <vector>
+
+/*
+ * Immutable neighborhood model on compact encodings.
+ *
+ * rowStore holds the entities the neighbors were computed for (movies for IBCF, users for UBCF) and
+ * columnStore is its transpose, used to look up the ratings of the neighbors. Predictions are the
+ * similarity-weighted average of the neighbor ratings, or the row average when no neighbor is rated.
+ * With a baseline predictor the fallback is the baseline estimate, and in BaselineMode::Residual the neighbors
+ * are averaged on their residuals from the baseline, which are added back to the baseline of the pair.
+ * All methods are const, so one model can serve any number of threads.
+ */
+class CompactModel {
+public:
+	//Constructor.
+    CompactModel(const CompactStore& rowStore, const CompactStore& columnStore, const CompactNeighbors& neighbors);
+
+    //Predicts the ratings of a user for a list of movies, in the same order. -1 where no prediction is possible.
+    void predictUser(int userId, const std::vector<int>& movieIds, std::vector<float>& predictions) const;
+
+    //Predicts the ratings of a list of users for a movie, in the same order. -1 where no prediction is possible.
+    void predictMovie(int movieId, const std::vector<int>& userIds, std::vector<float>& predictions) const;
+
+    //Predicts the rating of a user for a movie. -1 if no prediction is possible.
+    float predict(int userId, int movieId) const;
+
+    /* Returns up to count (movieId, predicted rating) pairs of movies the user has not rated, best first.
+    IBCF ranks every unrated movie, UBCF ranks the movies rated by the neighbors of the user.
+    Nothing is returned for unknown users. */
+    void recommend(int userId, size_t count, std::vector<std::pair<int, float>>& recommendations) const;
+
+    //Keeps the count best (movieId, score) pairs, highest score first and lower ids first on ties.
+    static void rankRecommendations(std::vector<std::pair<int, float>>& recommendations, size_t count);
+
+    /* Sets the baseline used for fallbacks and residuals. The predictor must be fitted on
+    the row and column stores of this model. */
+    void setBaseline(const BaselinePredictor& baseline, BaselineMode mode);
+
+    //Returns true for IBCF, false for UBCF.
+    bool isMovieBased() const;
+
+    //Returns the bytes of the stores, the neighbor lists and the baseline.
+    MemoryUsage getMemoryUsage() const;
+
+    const CompactStore& getRowStore() const;
+    const CompactStore& getColumnStore() const;
+    const CompactNeighbors& getNeighbors() const;
+
+private:
+    CompactStore rowStore;
+    CompactStore columnStore;
+    CompactNeighbors neighbors;
+    BaselinePredictor baseline;
+    BaselineMode baselineMode;
+
+    /* Predicts the rating of a rowStore row from the decoded ratings of the other entity (lookupRow of columnStore),
+    given as column ids (sorted) and ratings. -1 for a missing row or lookupRow. */
+    float predictRow(long row, long lookupRow, const std::vector<int>& columns, const std::vector<float>& ratings) const;
+
+    //Returns the baseline of a columnStore row without the bias of the rowStore row, 0 without a baseline.
+    float lookupBase(long lookupRow) const;
+
+    /* Returns the prediction of a rowStore row from its neighbor sums, given base = lookupBase() of the other entity.
+    Falls back to the baseline or the row average without rated neighbors. */
+    float finishPrediction(long row, float base, float weightedSum, float similaritySum) const;
+
+    //Returns the baseline bias of a rowStore row or a columnStore row, 0 for -1.
+    float rowBias(long row) const;
+    float columnBias(long row) const;
+};
+
+#endif // COMPACTMODEL_H
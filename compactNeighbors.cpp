@@ -0,0 +1,256 @@
+#include "compactNeighbors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+namespace {
+//Fixed-size header of a neighbor snapshot file, followed by the counts, the neighbor rows and the similarity codes.
+struct NeighborSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint64_t rowCount;
+    uint64_t capacity;
+    uint64_t neighborCount;
+    uint64_t buildKey;
+};
+
+const char neighborSnapshotMagic[8] = {'M', 'R', 'S', 'N', 'E', 'I', 'G', 'H'};
+const uint32_t neighborSnapshotVersion = 1;
+}
+
+CompactNeighbors::CompactNeighbors(size_t rowCount, size_t capacity, SimilarityCodec codec)
+    : capacity(capacity), codec(codec), packed(false), counts(rowCount, 0), offsets(rowCount + 1, 0),
+      neighbors(rowCount * capacity, 0) {
+    for (size_t row = 0; row <= rowCount; ++row) offsets[row] = row * capacity;
+    if (codec == SimilarityCodec::Byte) byteCodes.assign(rowCount * capacity, 0);
+    else shortCodes.assign(rowCount * capacity, 0);
+}
+
+void CompactNeighbors::setRow(size_t row, const std::vector<std::pair<uint32_t, float>>& rowNeighbors) {
+    if (packed) {
+        std::cerr << "err: neighbor-lists-are-packed-and-read-only.\n";
+        return;
+    }
+    float maxCode = (codec == SimilarityCodec::Byte) ? 255.0f : 65535.0f;
+    size_t base = offsets[row];
+    uint32_t n = 0;
+
+    for (const auto& neighbor : rowNeighbors) {
+        if (n >= capacity) break;
+        if (neighbor.second <= 0.0f) continue; //Non-positive similarities are never used.
+
+        //Positive similarities never round down to 0, otherwise they would be lost.
+        float code = std::min(std::max(std::round(neighbor.second * maxCode), 1.0f), maxCode);
+        neighbors[base + n] = neighbor.first;
+        if (codec == SimilarityCodec::Byte) byteCodes[base + n] = static_cast<uint8_t>(code);
+        else shortCodes[base + n] = static_cast<uint16_t>(code);
+        n++;
+    }
+    counts[row] = n;
+}
+
+void CompactNeighbors::pack() {
+    if (packed) return;
+    //New offsets are never larger than the old ones, so rows can be moved forward in place.
+    uint64_t next = 0;
+    for (size_t row = 0; row < counts.size(); ++row) {
+        uint64_t from = offsets[row];
+        for (uint32_t n = 0; n < counts[row]; ++n) {
+            neighbors[next + n] = neighbors[from + n];
+            if (codec == SimilarityCodec::Byte) byteCodes[next + n] = byteCodes[from + n];
+            else shortCodes[next + n] = shortCodes[from + n];
+        }
+        offsets[row] = next;
+        next += counts[row];
+    }
+    offsets[counts.size()] = next;
+
+    neighbors.resize(next);
+    neighbors.shrink_to_fit();
+    if (codec == SimilarityCodec::Byte) { byteCodes.resize(next); byteCodes.shrink_to_fit(); }
+    else { shortCodes.resize(next); shortCodes.shrink_to_fit(); }
+    packed = true;
+}
+
+size_t CompactNeighbors::getNeighborCount() const {
+    size_t total = 0;
+    for (uint32_t count : counts) total += count;
+    return total;
+}
+
+size_t CompactNeighbors::getCount(size_t row) const {
+    return counts[row];
+}
+
+uint32_t CompactNeighbors::getNeighbor(size_t row, size_t n) const {
+    return neighbors[offsets[row] + n];
+}
+
+float CompactNeighbors::getSimilarity(size_t row, size_t n) const {
+    if (codec == SimilarityCodec::Byte) return byteCodes[offsets[row] + n] * (1.0f / 255.0f);
+    return shortCodes[offsets[row] + n] * (1.0f / 65535.0f);
+}
+
+void CompactNeighbors::decodeSimilarities(size_t row, float* similarities) const {
+    size_t base = offsets[row];
+    if (codec == SimilarityCodec::Byte) {
+        for (uint32_t n = 0; n < counts[row]; ++n) similarities[n] = byteCodes[base + n] * (1.0f / 255.0f);
+    } else {
+        for (uint32_t n = 0; n < counts[row]; ++n) similarities[n] = shortCodes[base + n] * (1.0f / 65535.0f);
+    }
+}
+
+size_t CompactNeighbors::getRowCount() const {
+    return counts.size();
+}
+
+size_t CompactNeighbors::getCapacity() const {
+    return capacity;
+}
+
+size_t CompactNeighbors::capacityFor(size_t rowCount, int k) {
+    if (k <= 0 || rowCount == 0) return 0;
+    return std::min(static_cast<size_t>(k), rowCount - 1);
+}
+
+void CompactNeighbors::pushCandidate(std::vector<NeighborCandidate>& heap, size_t capacity, const NeighborCandidate& candidate) {
+    if (heap.size() < capacity) {
+        heap.push_back(candidate);
+        std::push_heap(heap.begin(), heap.end(), std::greater<NeighborCandidate>());
+    } else if (capacity > 0 && heap.front() < candidate) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<NeighborCandidate>());
+        heap.back() = candidate;
+        std::push_heap(heap.begin(), heap.end(), std::greater<NeighborCandidate>());
+    }
+}
+
+void CompactNeighbors::sortCandidates(std::vector<NeighborCandidate>& heap, std::vector<std::pair<uint32_t, float>>& rowNeighbors) {
+    std::sort(heap.begin(), heap.end(), std::greater<NeighborCandidate>());
+    rowNeighbors.clear();
+    for (const NeighborCandidate& c : heap) rowNeighbors.emplace_back(c.second, c.first);
+}
+
+CompactNeighbors CompactNeighbors::fromCandidates(std::vector<std::vector<NeighborCandidate>>& heaps, size_t capacity,
+                                                  SimilarityCodec codec) {
+    CompactNeighbors neighbors(heaps.size(), capacity, codec);
+    std::vector<std::pair<uint32_t, float>> rowNeighbors;
+    for (size_t row = 0; row < heaps.size(); ++row) {
+        sortCandidates(heaps[row], rowNeighbors);
+        neighbors.setRow(row, rowNeighbors);
+    }
+    neighbors.pack();
+    return neighbors;
+}
+
+SimilarityCodec CompactNeighbors::getCodec() const {
+    return codec;
+}
+
+MemoryUsage CompactNeighbors::getMemoryUsage() const {
+    MemoryUsage usage;
+    size_t codeBytes = (codec == SimilarityCodec::Byte) ? sizeof(uint8_t) : sizeof(uint16_t);
+    usage.payloadBytes = getNeighborCount() * (sizeof(uint32_t) + codeBytes);
+    size_t total = counts.capacity() * sizeof(uint32_t)
+                 + offsets.capacity() * sizeof(uint64_t)
+                 + neighbors.capacity() * sizeof(uint32_t)
+                 + byteCodes.capacity()
+                 + shortCodes.capacity() * sizeof(uint16_t);
+    usage.overheadBytes = total - usage.payloadBytes;
+    return usage;
+}
+
+size_t CompactNeighbors::getByteSize() const {
+    return counts.size() * sizeof(uint32_t)
+         + offsets.size() * sizeof(uint64_t)
+         + neighbors.size() * sizeof(uint32_t)
+         + byteCodes.size()
+         + shortCodes.size() * sizeof(uint16_t);
+}
+
+bool CompactNeighbors::saveSnapshot(const std::string& fileName, uint64_t buildKey) const {
+    if (!packed) {
+        std::cerr << "err: only-packed-neighbor-lists-can-be-saved.\n";
+        return false;
+    }
+    std::ofstream outfile(fileName, std::ios::binary);
+    if (!outfile.is_open()) {
+        std::cerr << "err: could-not-open-file-for-writing-''" << fileName << "''\n";
+        return false;
+    }
+    NeighborSnapshotHeader header;
+    std::memcpy(header.magic, neighborSnapshotMagic, sizeof(header.magic));
+    header.version = neighborSnapshotVersion;
+    header.codec = static_cast<uint32_t>(codec);
+    header.rowCount = counts.size();
+    header.capacity = capacity;
+    header.neighborCount = neighbors.size();
+    header.buildKey = buildKey;
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(uint32_t));
+    outfile.write(reinterpret_cast<const char*>(neighbors.data()), neighbors.size() * sizeof(uint32_t));
+    if (codec == SimilarityCodec::Byte) outfile.write(reinterpret_cast<const char*>(byteCodes.data()), byteCodes.size());
+    else outfile.write(reinterpret_cast<const char*>(shortCodes.data()), shortCodes.size() * sizeof(uint16_t));
+    return static_cast<bool>(outfile);
+}
+
+bool CompactNeighbors::loadSnapshot(const std::string& fileName, uint64_t buildKey) {
+    std::ifstream infile(fileName, std::ios::binary);
+    if (!infile.is_open()) return false;
+    NeighborSnapshotHeader header;
+    if (!infile.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, neighborSnapshotMagic, sizeof(header.magic)) != 0
+        || header.version != neighborSnapshotVersion || header.codec > static_cast<uint32_t>(SimilarityCodec::Short)) {
+        std::cerr << "err: invalid-neighbor-snapshot-''" << fileName << "''\n";
+        return false;
+    }
+    if (header.buildKey != buildKey) {
+        std::cerr << "err: neighbor-snapshot-''" << fileName << "''-was-built-from-other-data-or-settings.\n";
+        return false;
+    }
+
+    //Sizes are checked against the file before anything is allocated.
+    infile.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(infile.tellg());
+    infile.seekg(sizeof(header), std::ios::beg);
+    uint64_t codeBytes = (header.codec == static_cast<uint32_t>(SimilarityCodec::Byte)) ? 1 : 2;
+    if (header.rowCount > fileSize / sizeof(uint32_t) || header.neighborCount > fileSize / (sizeof(uint32_t) + codeBytes)
+        || fileSize != sizeof(header) + header.rowCount * sizeof(uint32_t) + header.neighborCount * (sizeof(uint32_t) + codeBytes)) {
+        std::cerr << "err: invalid-neighbor-snapshot-''" << fileName << "''\n";
+        return false;
+    }
+
+    CompactNeighbors loaded(0, header.capacity, static_cast<SimilarityCodec>(header.codec));
+    loaded.counts.resize(header.rowCount);
+    loaded.neighbors.resize(header.neighborCount);
+    infile.read(reinterpret_cast<char*>(loaded.counts.data()), loaded.counts.size() * sizeof(uint32_t));
+    infile.read(reinterpret_cast<char*>(loaded.neighbors.data()), loaded.neighbors.size() * sizeof(uint32_t));
+    if (loaded.codec == SimilarityCodec::Byte) {
+        loaded.byteCodes.resize(header.neighborCount);
+        infile.read(reinterpret_cast<char*>(loaded.byteCodes.data()), loaded.byteCodes.size());
+    } else {
+        loaded.shortCodes.resize(header.neighborCount);
+        infile.read(reinterpret_cast<char*>(loaded.shortCodes.data()), loaded.shortCodes.size() * sizeof(uint16_t));
+    }
+
+    //Offsets are rebuilt from the counts, which must add up to the stored neighbors and point into the rows.
+    bool valid = static_cast<bool>(infile);
+    loaded.offsets.assign(header.rowCount + 1, 0);
+    for (size_t row = 0; row < header.rowCount && valid; ++row) {
+        valid = loaded.counts[row] <= header.capacity;
+        loaded.offsets[row + 1] = loaded.offsets[row] + loaded.counts[row];
+    }
+    valid = valid && loaded.offsets[header.rowCount] == header.neighborCount;
+    for (size_t n = 0; n < loaded.neighbors.size() && valid; ++n) valid = loaded.neighbors[n] < header.rowCount;
+    if (!valid) {
+        std::cerr << "err: invalid-neighbor-snapshot-''" << fileName << "''\n";
+        return false;
+    }
+    loaded.packed = true;
+    *this = std::move(loaded);
+    return true;
+}
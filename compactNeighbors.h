@@ -0,0 +1,105 @@
+#ifndef COMPACTNEIGHBORS_H
+#define COMPACTNEIGHBORS_H
+
+#include "memoryTracker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Encoding of the similarity values kept in a CompactNeighbors.
+enum class SimilarityCodec {
+    Byte, //8-bit codes, 1/255 steps between 0 and 1.
+    Short //16-bit codes, 1/65535 steps between 0 and 1.
+};
+
+//Candidate neighbor of a row during a top-k selection, (similarity, neighborRow). Ties go to the higher row.
+using NeighborCandidate = std::pair<float, uint32_t>;
+
+/*
+ * Flat top-K neighbor lists of the rows of a CompactStore.
+ *
+ * While the lists are filled every row owns a fixed slot of "capacity" neighbors, so rows can be filled from several
+ * threads without locks. pack() then removes the unused slots, so rows with few neighbors cost only what they hold.
+ * Neighbors are kept as row indices of the store they were computed from and similarities are quantized to 8 or 16 bits.
+ * Only positive similarities are stored, which is all that kNN selection ever uses.
+ */
+class CompactNeighbors {
+public:
+	//Constructor. Creates empty lists for rowCount rows with at most capacity neighbors each.
+    CompactNeighbors(size_t rowCount = 0, size_t capacity = 0, SimilarityCodec codec = SimilarityCodec::Short);
+
+    //Sets the neighbors of a row as (neighborRow, similarity) pairs, most similar first. Extra pairs are dropped.
+    //Rows can only be set before pack().
+    void setRow(size_t row, const std::vector<std::pair<uint32_t, float>>& neighbors);
+
+    //Removes the unused slots of the rows. The lists are read-only afterwards.
+    void pack();
+
+    //Returns the total number of stored neighbors.
+    size_t getNeighborCount() const;
+
+    //Returns the number of neighbors of a row.
+    size_t getCount(size_t row) const;
+
+    //Returns the row index of the n-th neighbor of a row.
+    uint32_t getNeighbor(size_t row, size_t n) const;
+
+    //Returns the decoded similarity of the n-th neighbor of a row.
+    float getSimilarity(size_t row, size_t n) const;
+
+    //Returns the neighbor row indices of a row, getCount(row) values.
+    const uint32_t* getNeighborRow(size_t row) const { return neighbors.data() + offsets[row]; }
+
+    //Decodes the similarities of all the neighbors of a row into similarities, getCount(row) values.
+    void decodeSimilarities(size_t row, float* similarities) const;
+
+    //Returns the number of rows.
+    size_t getRowCount() const;
+
+    //Returns the maximum number of neighbors per row.
+    size_t getCapacity() const;
+
+    //Returns the slots per row for k neighbors among rowCount rows: a row has at most rowCount - 1 neighbors.
+    static size_t capacityFor(size_t rowCount, int k);
+
+    //Adds a candidate to the min-heap of a row, which keeps its capacity best candidates.
+    static void pushCandidate(std::vector<NeighborCandidate>& heap, size_t capacity, const NeighborCandidate& candidate);
+
+    //Sorts the candidate heap of a row, most similar first, into (neighborRow, similarity) pairs.
+    static void sortCandidates(std::vector<NeighborCandidate>& heap, std::vector<std::pair<uint32_t, float>>& rowNeighbors);
+
+    //Returns the packed lists of the candidate heaps of every row.
+    static CompactNeighbors fromCandidates(std::vector<std::vector<NeighborCandidate>>& heaps, size_t capacity, SimilarityCodec codec);
+
+    //Returns the codec used for similarities.
+    SimilarityCodec getCodec() const;
+
+    //Returns the number of bytes used by the lists.
+    size_t getByteSize() const;
+
+    //Returns the bytes held by the lists. Payload is the stored neighbors, overhead the row arrays and unused slots.
+    MemoryUsage getMemoryUsage() const;
+
+    /* Saves the packed lists to a file. buildKey identifies the store and settings they were built from,
+    so loadSnapshot() can refuse lists of other data. Returns false on failure. */
+    bool saveSnapshot(const std::string& fileName, uint64_t buildKey) const;
+
+    /* Replaces the lists with the ones saved in a file. Returns false, and keeps the lists, if the file cannot be
+    read, is not a valid neighbor snapshot or was saved with another buildKey. */
+    bool loadSnapshot(const std::string& fileName, uint64_t buildKey);
+
+private:
+    size_t capacity;
+    SimilarityCodec codec;
+    bool packed;                      //True once the unused slots are removed.
+    std::vector<uint32_t> counts;     //Number of neighbors of every row.
+    std::vector<uint64_t> offsets;    //First slot of every row, rowCount + 1 values.
+    std::vector<uint32_t> neighbors;  //Neighbor row indices.
+    std::vector<uint8_t> byteCodes;   //Similarity codes for SimilarityCodec::Byte.
+    std::vector<uint16_t> shortCodes; //Similarity codes for SimilarityCodec::Short.
+};
+
+#endif // COMPACTNEIGHBORS_H
@@ -0,0 +1,390 @@
+#include "compactStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+//Header at the start of every snapshot image.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint32_t movieBased;
+    uint32_t reserved;
+    uint64_t rowCount;
+    uint64_t entryCount;
+    uint64_t codeBytes;
+    uint64_t columnBytes;
+};
+
+const char snapshotMagic[8] = {'M', 'R', 'S', 'S', 'T', 'O', 'R', 'E'};
+const uint32_t snapshotVersion = 1;
+
+//Rounds a byte count up to 8 so every array of the image is aligned.
+size_t align8(size_t bytes) {
+    return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+//Byte offsets of the arrays of an image, in image order.
+struct SnapshotLayout {
+    size_t entryOffsets, columnOffsets, rowIds, rowNorms, rowSums, codes, columnBytes, total;
+
+    explicit SnapshotLayout(const SnapshotHeader& h) {
+        entryOffsets = align8(sizeof(SnapshotHeader));
+        columnOffsets = entryOffsets + (h.rowCount + 1) * sizeof(uint64_t);
+        rowIds = columnOffsets + (h.rowCount + 1) * sizeof(uint64_t);
+        rowNorms = rowIds + align8(h.rowCount * sizeof(int));
+        rowSums = rowNorms + align8(h.rowCount * sizeof(float));
+        codes = rowSums + align8(h.rowCount * sizeof(float));
+        columnBytes = codes + align8(h.codeBytes);
+        total = columnBytes + h.columnBytes;
+    }
+};
+}
+
+CompactStore::CompactStore() : codec(RatingCodec::Nibble), movieBased(true) {
+    buildDecodeTable();
+    pack(std::vector<uint64_t>(1, 0), std::vector<uint64_t>(1, 0), {}, {}, {}, {}, {});
+}
+
+CompactStore::CompactStore(const DataHash2D& dh, bool isMovieBased, RatingCodec codec) : codec(codec), movieBased(isMovieBased) {
+    RatingMap movieRatings = dh.getRatingMap();
+
+    //Flatten the hash map into (rowId, columnId, rating) triplets.
+    std::vector<std::tuple<int, int, float>> triplets;
+    triplets.reserve(dh.getDatasetSize());
+    for (const auto& me : movieRatings) { //me: Movie entry
+        for (const auto& ue : me.second) { //ue: User entry
+            if (isMovieBased) triplets.emplace_back(me.first, ue.first, ue.second);
+            else triplets.emplace_back(ue.first, me.first, ue.second);
+        }
+    }
+    build(triplets);
+}
+
+CompactStore CompactStore::transpose() const {
+    CompactStore transposed;
+    transposed.codec = codec;
+    transposed.movieBased = !movieBased;
+
+    std::vector<std::tuple<int, int, float>> triplets;
+    triplets.reserve(entryCount);
+    for (size_t row = 0; row < rowCount; ++row) {
+        Cursor cursor(*this, row);
+        while (cursor.next()) triplets.emplace_back(cursor.column(), rowIds[row], cursor.rating());
+    }
+    transposed.build(triplets);
+    return transposed;
+}
+
+DataHash2D CompactStore::toDataHash2D() const {
+    DataHash2D dh;
+    for (size_t row = 0; row < rowCount; ++row) {
+        Cursor cursor(*this, row);
+        while (cursor.next()) {
+            if (movieBased) dh.addRating(rowIds[row], cursor.column(), cursor.rating());
+            else dh.addRating(cursor.column(), rowIds[row], cursor.rating());
+        }
+    }
+    return dh;
+}
+
+void CompactStore::build(std::vector<std::tuple<int, int, float>>& triplets) {
+    //Rows and columns are encoded in ascending id order.
+    std::sort(triplets.begin(), triplets.end());
+
+    //Both codecs hold ratings in [0, 5]; nibble codes only hold half-star steps of it.
+    bool outOfRange = false;
+    for (const auto& t : triplets) {
+        float rating = std::get<2>(t);
+        if (!outOfRange && (rating < 0.0f || rating > 5.0f)) {
+            std::cerr << "err: rating-" << rating << "-is-outside-0-5-and-is-clamped.\n";
+            outOfRange = true;
+        }
+        float doubled = rating * 2.0f;
+        if (this->codec == RatingCodec::Nibble && doubled != std::round(doubled)) {
+            std::cerr << "err: rating-" << rating << "-is-not-a-half-star-step-falling-back-to-8-bit-codes.\n";
+            this->codec = RatingCodec::Byte;
+        }
+        if (outOfRange && this->codec == RatingCodec::Byte) break;
+    }
+    buildDecodeTable();
+
+    size_t numEntries = triplets.size();
+    std::vector<int> ids;
+    std::vector<uint64_t> entryStarts, columnStarts;
+    std::vector<float> norms, sums;
+    std::vector<uint8_t> rowCodes(this->codec == RatingCodec::Nibble ? (numEntries + 1) / 2 : numEntries, 0);
+    std::vector<uint8_t> columns;
+    columns.reserve(numEntries * 2);
+
+    int previousColumn = 0;
+    float norm = 0.0f, sum = 0.0f;
+    for (size_t e = 0; e < numEntries; ++e) {
+        int rowId = std::get<0>(triplets[e]);
+        int columnId = std::get<1>(triplets[e]);
+        float rating = std::get<2>(triplets[e]);
+
+        //Start of a new row.
+        if (ids.empty() || ids.back() != rowId) {
+            if (!ids.empty()) {
+                norms.push_back(std::sqrt(norm));
+                sums.push_back(sum);
+            }
+            ids.push_back(rowId);
+            entryStarts.push_back(e);
+            columnStarts.push_back(columns.size());
+            previousColumn = 0;
+            norm = sum = 0.0f;
+        }
+
+        //Varint: 7 bits per byte, high bit set while more bytes follow.
+        uint32_t delta = static_cast<uint32_t>(columnId - previousColumn);
+        while (delta >= 0x80) {
+            columns.push_back(static_cast<uint8_t>(delta | 0x80));
+            delta >>= 7;
+        }
+        columns.push_back(static_cast<uint8_t>(delta));
+        previousColumn = columnId;
+
+        uint8_t code = encodeRating(rating);
+        if (this->codec == RatingCodec::Nibble) rowCodes[e >> 1] |= static_cast<uint8_t>(code << ((e & 1) << 2));
+        else rowCodes[e] = code;
+
+        //Norms and sums are computed from the decoded value so they match what the kernels read.
+        float decoded = decodeTable[code];
+        norm += decoded * decoded;
+        sum += decoded;
+    }
+    if (!ids.empty()) {
+        norms.push_back(std::sqrt(norm));
+        sums.push_back(sum);
+    }
+    entryStarts.push_back(numEntries);
+    columnStarts.push_back(columns.size());
+
+    pack(entryStarts, columnStarts, ids, norms, sums, rowCodes, columns);
+}
+
+void CompactStore::pack(const std::vector<uint64_t>& entryStarts, const std::vector<uint64_t>& columnStarts,
+                        const std::vector<int>& ids, const std::vector<float>& norms, const std::vector<float>& sums,
+                        const std::vector<uint8_t>& rowCodes, const std::vector<uint8_t>& columns) {
+    SnapshotHeader header;
+    std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.codec = static_cast<uint32_t>(codec);
+    header.movieBased = movieBased ? 1 : 0;
+    header.reserved = 0;
+    header.rowCount = ids.size();
+    header.entryCount = entryStarts.back();
+    header.codeBytes = rowCodes.size();
+    header.columnBytes = columns.size();
+    SnapshotLayout layout(header);
+
+    //uint64_t storage keeps the image 8-byte aligned.
+    uint64_t* words = new uint64_t[(layout.total + 7) / 8]();
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(words);
+    auto copy = [&](size_t offset, const void* data, size_t size) { if (size > 0) std::memcpy(bytes + offset, data, size); };
+    copy(0, &header, sizeof(header));
+    copy(layout.entryOffsets, entryStarts.data(), entryStarts.size() * sizeof(uint64_t));
+    copy(layout.columnOffsets, columnStarts.data(), columnStarts.size() * sizeof(uint64_t));
+    copy(layout.rowIds, ids.data(), ids.size() * sizeof(int));
+    copy(layout.rowNorms, norms.data(), norms.size() * sizeof(float));
+    copy(layout.rowSums, sums.data(), sums.size() * sizeof(float));
+    copy(layout.codes, rowCodes.data(), rowCodes.size());
+    copy(layout.columnBytes, columns.data(), columns.size());
+
+    attach(std::shared_ptr<const uint8_t>(bytes, [words](const uint8_t*) { delete[] words; }), layout.total);
+}
+
+bool CompactStore::attach(std::shared_ptr<const uint8_t> newImage, size_t newImageSize) {
+    if (newImageSize < sizeof(SnapshotHeader)) return false;
+    SnapshotHeader header;
+    std::memcpy(&header, newImage.get(), sizeof(header));
+    if (std::memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header.version != snapshotVersion) return false;
+    if (header.codec > static_cast<uint32_t>(RatingCodec::Byte)) return false;
+    //Sizes larger than the image would overflow the layout arithmetic.
+    if (header.rowCount > newImageSize / sizeof(uint64_t) || header.codeBytes > newImageSize || header.columnBytes > newImageSize) return false;
+    SnapshotLayout layout(header);
+    if (layout.total != newImageSize) return false;
+    size_t expectedCodeBytes = (header.codec == static_cast<uint32_t>(RatingCodec::Nibble)) ? (header.entryCount + 1) / 2 : header.entryCount;
+    if (header.codeBytes != expectedCodeBytes) return false;
+
+    //Offsets must be monotonic and stay inside their sections, and every row must hold exactly its entries'
+    //varints of at most 5 bytes (32-bit deltas), so that cursors never read past the image.
+    const uint8_t* bytes = newImage.get();
+    const uint64_t* entryStarts = reinterpret_cast<const uint64_t*>(bytes + layout.entryOffsets);
+    const uint64_t* columnStarts = reinterpret_cast<const uint64_t*>(bytes + layout.columnOffsets);
+    const uint8_t* columns = bytes + layout.columnBytes;
+    if (entryStarts[0] != 0 || columnStarts[0] != 0) return false;
+    if (entryStarts[header.rowCount] != header.entryCount || columnStarts[header.rowCount] != header.columnBytes) return false;
+    for (size_t row = 0; row < header.rowCount; ++row) {
+        if (entryStarts[row + 1] < entryStarts[row] || entryStarts[row + 1] > header.entryCount) return false;
+        if (columnStarts[row + 1] < columnStarts[row] || columnStarts[row + 1] > header.columnBytes) return false;
+        uint64_t varints = 0;
+        int varintBytes = 0;
+        for (uint64_t c = columnStarts[row]; c < columnStarts[row + 1]; ++c) {
+            if (++varintBytes > 5) return false;
+            if ((columns[c] & 0x80) == 0) {
+                varints++;
+                varintBytes = 0;
+            }
+        }
+        if (varints != entryStarts[row + 1] - entryStarts[row]) return false;
+        if (columnStarts[row + 1] > columnStarts[row] && (columns[columnStarts[row + 1] - 1] & 0x80)) return false;
+    }
+
+    image = newImage;
+    imageSize = newImageSize;
+    codec = static_cast<RatingCodec>(header.codec);
+    movieBased = header.movieBased != 0;
+    rowCount = header.rowCount;
+    entryCount = header.entryCount;
+    entryOffsets = reinterpret_cast<const uint64_t*>(bytes + layout.entryOffsets);
+    columnOffsets = reinterpret_cast<const uint64_t*>(bytes + layout.columnOffsets);
+    rowIds = reinterpret_cast<const int*>(bytes + layout.rowIds);
+    rowNorms = reinterpret_cast<const float*>(bytes + layout.rowNorms);
+    rowSums = reinterpret_cast<const float*>(bytes + layout.rowSums);
+    codes = bytes + layout.codes;
+    columnBytes = bytes + layout.columnBytes;
+    buildDecodeTable();
+    return true;
+}
+
+bool CompactStore::saveSnapshot(const std::string& fileName) const {
+    std::ofstream outfile(fileName, std::ios::binary);
+    if (!outfile.is_open()) {
+        std::cerr << "err: could-not-open-file-for-writing-''" << fileName << "''\n";
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(image.get()), imageSize);
+    return static_cast<bool>(outfile);
+}
+
+CompactStore CompactStore::loadSnapshot(const std::string& fileName) {
+    CompactStore store;
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "err: could-not-open-file-''" << fileName << "''\n";
+        return store;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        std::cerr << "err: could-not-read-snapshot-''" << fileName << "''\n";
+        close(fd);
+        return store;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); //The mapping stays valid after the descriptor is closed.
+    if (mapping == MAP_FAILED) {
+        std::cerr << "err: could-not-map-snapshot-''" << fileName << "''\n";
+        return store;
+    }
+
+    std::shared_ptr<const uint8_t> mapped(static_cast<const uint8_t*>(mapping), [size](const uint8_t* p) {
+        munmap(const_cast<uint8_t*>(p), size);
+    });
+    if (!store.attach(mapped, size)) std::cerr << "err: invalid-snapshot-file-''" << fileName << "''\n";
+    return store;
+}
+
+void CompactStore::buildDecodeTable() {
+    float step = (codec == RatingCodec::Nibble) ? 0.5f : 0.02f;
+    for (int c = 0; c < 256; ++c) decodeTable[c] = c * step;
+}
+
+uint8_t CompactStore::encodeRating(float rating) const {
+    float scale = (codec == RatingCodec::Nibble) ? 2.0f : 50.0f;
+    float maxCode = (codec == RatingCodec::Nibble) ? 10.0f : 250.0f;
+    float code = std::round(rating * scale);
+    return static_cast<uint8_t>(std::min(std::max(code, 0.0f), maxCode));
+}
+
+CompactStore::Cursor CompactStore::getCursor(size_t row) const {
+    return Cursor(*this, row);
+}
+
+long CompactStore::findRow(int id) const {
+    const int* i = std::lower_bound(rowIds, rowIds + rowCount, id); //i: Iterator
+    if (i == rowIds + rowCount || *i != id) return -1;
+    return static_cast<long>(i - rowIds);
+}
+
+int CompactStore::getRowId(size_t row) const {
+    return rowIds[row];
+}
+
+size_t CompactStore::getRowLength(size_t row) const {
+    return entryOffsets[row + 1] - entryOffsets[row];
+}
+
+float CompactStore::getRowNorm(size_t row) const {
+    return rowNorms[row];
+}
+
+float CompactStore::getRowAverage(size_t row) const {
+    size_t length = getRowLength(row);
+    if (length == 0) return -1.0f;
+    return rowSums[row] / length;
+}
+
+float CompactStore::getRating(size_t row, int column) const {
+    Cursor cursor(*this, row);
+    while (cursor.next()) {
+        if (cursor.column() == column) return cursor.rating();
+        if (cursor.column() > column) break; //Columns are sorted.
+    }
+    return -1.0f;
+}
+
+void CompactStore::decodeRow(size_t row, std::vector<int>& columns, std::vector<float>& ratings) const {
+    columns.clear();
+    ratings.clear();
+    Cursor cursor(*this, row);
+    while (cursor.next()) {
+        columns.push_back(cursor.column());
+        ratings.push_back(cursor.rating());
+    }
+}
+
+size_t CompactStore::getRowCount() const {
+    return rowCount;
+}
+
+size_t CompactStore::getEntryCount() const {
+    return entryCount;
+}
+
+bool CompactStore::isMovieBased() const {
+    return movieBased;
+}
+
+RatingCodec CompactStore::getCodec() const {
+    return codec;
+}
+
+size_t CompactStore::getByteSize() const {
+    return imageSize;
+}
+
+const uint8_t* CompactStore::getImage() const {
+    return image.get();
+}
+
+MemoryUsage CompactStore::getMemoryUsage() const {
+    MemoryUsage usage;
+    if (rowCount == 0) return usage;
+    size_t codeBytes = (codec == RatingCodec::Nibble) ? (entryCount + 1) / 2 : entryCount;
+    usage.payloadBytes = codeBytes + columnOffsets[rowCount];
+    usage.overheadBytes = imageSize - usage.payloadBytes;
+    return usage;
+}
@@ -0,0 +1,184 @@
+#ifndef COMPACTSTORE_H
+#define COMPACTSTORE_H
+
+#include "dataHash2D.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//Encoding of the rating codes kept in a CompactStore.
+enum class RatingCodec {
+    Nibble, //4-bit codes, two ratings per byte. Half-star steps from 0 to 5.
+    Byte    //8-bit codes, one rating per byte. 0.02 steps from 0 to 5.
+};
+
+/*
+ * Read-only, row-major compressed copy of a DataHash2D.
+ *
+ * Every row is one entity (a movie or a user) and holds the ids of the other side together with the ratings.
+ * Column ids of a row are sorted and stored as varint-packed deltas, ratings are stored as 4-bit or 8-bit codes
+ * that are turned back into floats through a small decode lookup table. A rating takes half or one byte and a
+ * column id takes one or two bytes on typical data, instead of a full hash node for every rating.
+ *
+ * Rows are meant to be read sequentially with a Cursor, which is how the similarity and prediction kernels walk them.
+ *
+ * All arrays live in one immutable image that is also the binary snapshot format. A store can be saved to a
+ * snapshot file and loaded back with mmap, so several processes reading the same snapshot share its pages.
+ * Copies of a store share the image.
+ */
+class CompactStore {
+public:
+	//Constructor. Creates an empty store.
+    CompactStore();
+
+    /* Constructor. Builds the compact store from a DataHash2D.
+    isMovieBased = true: Rows are movies, columns are users.
+    isMovieBased = false: Rows are users, columns are movies.
+    If a rating is not on the half-star grid, Nibble falls back to Byte. Ratings outside [0, 5] are reported and clamped. */
+    CompactStore(const DataHash2D& dh, bool isMovieBased, RatingCodec codec = RatingCodec::Nibble);
+
+    //Returns a store with rows and columns swapped (movie rows become user rows and the other way around).
+    CompactStore transpose() const;
+
+    //Decodes the store back into a DataHash2D.
+    DataHash2D toDataHash2D() const;
+
+    //Writes the store to a binary snapshot file. Returns false on failure.
+    bool saveSnapshot(const std::string& fileName) const;
+
+    //Maps a binary snapshot file written by saveSnapshot. Returns an empty store on failure.
+    static CompactStore loadSnapshot(const std::string& fileName);
+
+    //Sequential reader over a single row. Columns are visited in ascending id order.
+    class Cursor {
+    public:
+        Cursor(const CompactStore& store, size_t row);
+
+        //Moves to the next entry. Returns false when the row is exhausted.
+        bool next();
+
+        int column() const { return currentColumn; }   //Column id of the current entry.
+        float rating() const { return currentRating; } //Decoded rating of the current entry.
+
+    private:
+        const CompactStore* store;
+        const uint8_t* columnPtr; //Position in the varint column stream.
+        size_t entry;             //Index of the next entry in the code stream.
+        size_t end;               //One past the last entry of the row.
+        int currentColumn;
+        float currentRating;
+    };
+
+    //Returns a cursor positioned before the first entry of the row.
+    Cursor getCursor(size_t row) const;
+
+    //Returns the row index of an entity id, -1 if the id does not exist.
+    long findRow(int id) const;
+
+    //Returns the entity id of a row.
+    int getRowId(size_t row) const;
+
+    //Returns the number of entries in a row.
+    size_t getRowLength(size_t row) const;
+
+    //Returns the euclidean norm of the ratings of a row.
+    float getRowNorm(size_t row) const;
+
+    //Returns the average rating of a row, -1 if the row is empty.
+    float getRowAverage(size_t row) const;
+
+    //Returns the rating of a column in a row, -1 if not found. Linear in the row length.
+    float getRating(size_t row, int column) const;
+
+    //Decodes a whole row into two parallel arrays sorted by column id.
+    void decodeRow(size_t row, std::vector<int>& columns, std::vector<float>& ratings) const;
+
+    //Returns the number of rows.
+    size_t getRowCount() const;
+
+    //Returns the total number of ratings.
+    size_t getEntryCount() const;
+
+    //Returns true if rows are movies, false if rows are users.
+    bool isMovieBased() const;
+
+    //Returns the codec used for ratings.
+    RatingCodec getCodec() const;
+
+    //Returns the number of bytes used by the encoded arrays.
+    size_t getByteSize() const;
+
+    //Returns the image, getByteSize() bytes in the snapshot format.
+    const uint8_t* getImage() const;
+
+    //Returns the bytes of the image. Payload is the rating codes and column ids, overhead the row arrays, header and padding.
+    MemoryUsage getMemoryUsage() const;
+
+    //Returns the decoded value of a rating code.
+    float decodeRating(size_t entry) const;
+
+private:
+    RatingCodec codec;
+    bool movieBased;
+    size_t rowCount;
+    size_t entryCount;
+    std::shared_ptr<const uint8_t> image; //Snapshot image all arrays below point into, heap or mmap backed.
+    size_t imageSize;
+    const uint64_t* entryOffsets;  //First entry of every row, rowCount + 1 values.
+    const uint64_t* columnOffsets; //First byte of every row in columnBytes, rowCount + 1 values.
+    const int* rowIds;             //Entity id of every row, sorted ascending.
+    const float* rowNorms;         //Euclidean norm of every row.
+    const float* rowSums;          //Sum of the ratings of every row.
+    const uint8_t* codes;          //Rating codes, packed two per byte for Nibble.
+    const uint8_t* columnBytes;    //Varint-packed column id deltas.
+    float decodeTable[256];        //Code to rating lookup table.
+
+    //Fills decodeTable for the codec.
+    void buildDecodeTable();
+
+    //Returns the code of a rating for the codec.
+    uint8_t encodeRating(float rating) const;
+
+    //Sorts (rowId, columnId, rating) triplets and encodes them into a new image.
+    void build(std::vector<std::tuple<int, int, float>>& triplets);
+
+    //Lays the arrays out into a new heap image and attaches to it.
+    void pack(const std::vector<uint64_t>& entryOffsets, const std::vector<uint64_t>& columnOffsets,
+              const std::vector<int>& rowIds, const std::vector<float>& rowNorms, const std::vector<float>& rowSums,
+              const std::vector<uint8_t>& codes, const std::vector<uint8_t>& columnBytes);
+
+    //Points the arrays into an image. Returns false if the image is not a valid snapshot or its offsets leave their sections.
+    bool attach(std::shared_ptr<const uint8_t> image, size_t imageSize);
+};
+
+inline float CompactStore::decodeRating(size_t entry) const {
+    if (codec == RatingCodec::Nibble) return decodeTable[(codes[entry >> 1] >> ((entry & 1) << 2)) & 0x0F];
+    return decodeTable[codes[entry]];
+}
+
+inline CompactStore::Cursor::Cursor(const CompactStore& store, size_t row)
+    : store(&store), columnPtr(store.columnBytes + store.columnOffsets[row]),
+      entry(store.entryOffsets[row]), end(store.entryOffsets[row + 1]),
+      currentColumn(0), currentRating(0.0f) {}
+
+inline bool CompactStore::Cursor::next() {
+    if (entry >= end) return false;
+    //Varint: 7 bits per byte, high bit set while more bytes follow.
+    uint32_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = *columnPtr++;
+        delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    currentColumn += static_cast<int>(delta);
+    currentRating = store->decodeRating(entry++);
+    return true;
+}
+
+#endif // COMPACTSTORE_H
@@ -1,5 +1,5 @@
-#include "DataHash2D.h"
-#include "ThreadHandler.h"
+#include "dataHash2D.h"
+#include "threadHandler.h"
 
 #include <unordered_set>
 #include <queue>
@@ -162,6 +162,10 @@ size_t DataHash2D::getDatasetSize() const {
     return totalSize;
 }
 
+MemoryUsage DataHash2D::getMemoryUsage() const {
+    return MemoryTracker::ratingMapUsage(movieRatings);
+}
+
 void DataHash2D::printDataset() const {
     for (const auto& me : movieRatings) { //me: Movie entry
         std::cout << "[ ";
@@ -1,6 +1,8 @@
 #ifndef DATAHASH_2D_H
 #define DATAHASH_2D_H
 
+#include "memoryTracker.h"
+
 #include <unordered_map>
 #include <iostream>
 #include <vector>
@@ -62,6 +64,9 @@ public:
     //Prints dataset to the console.
     void printDataset() const;
 
+    //Returns the estimated bytes of the data set. Payload is the ids and ratings, overhead the hash nodes and buckets.
+    MemoryUsage getMemoryUsage() const;
+
 private:
     RatingMap movieRatings; //{ movieId => { userId => rating } } std::unordered_map<int, std::unordered_map<int, float>>;
     
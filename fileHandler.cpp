@@ -1,6 +1,6 @@
-#include "FileHandler.h"
-#include "DataHash2D.h"
-#include "ThreadHandler.h"
+#include "fileHandler.h"
+#include "dataHash2D.h"
+#include "threadHandler.h"
 
 #include <iostream>
 #include <fstream>
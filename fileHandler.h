@@ -1,8 +1,8 @@
 #ifndef FILEHANDLER_H
 #define FILEHANDLER_H
 
-#include "DataHash2D.h"
-#include "ThreadHandler.h"
+#include "dataHash2D.h"
+#include "threadHandler.h"
 
 #include <string>
 
@@ -0,0 +1,114 @@
+#include "loadGenerator.h"
+#include "recommendationServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+LoadGenerator::LoadGenerator(size_t numConnections, size_t depth, size_t recommendPercent, size_t recommendCount)
+    : numConnections(std::max<size_t>(numConnections, 1)), depth(std::max<size_t>(depth, 1)),
+      recommendPercent(std::min<size_t>(recommendPercent, 100)), recommendCount(recommendCount) {}
+
+bool LoadGenerator::run(const std::string& address, const CompactStore& testStore, size_t numRequests) const {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::pair<int, int>> pairs; //(userId, movieId) of the test store.
+    std::vector<int> movies;
+    std::vector<float> ratings;
+    for (size_t row = 0; row < testStore.getRowCount(); ++row) {
+        int id = testStore.getRowId(row);
+        testStore.decodeRow(row, movies, ratings);
+        for (int column : movies) pairs.push_back(testStore.isMovieBased() ? std::make_pair(column, id) : std::make_pair(id, column));
+    }
+    if (pairs.empty() || numRequests == 0) {
+        std::cerr << "err: no-requests-to-send.\n";
+        return false;
+    }
+
+    std::vector<std::vector<double>> latencies(numConnections); //Milliseconds, one list per connection.
+    std::vector<size_t> errors(numConnections, 0);
+    std::atomic<bool> failed(false);
+    auto client = [&](size_t c) {
+        int fd = RecommendationServer::connectTo(address);
+        if (fd < 0) {
+            failed = true;
+            return;
+        }
+        size_t quota = numRequests / numConnections + (c < numRequests % numConnections ? 1 : 0);
+        size_t next = c * pairs.size() / numConnections; //Connections start at different pairs.
+        size_t sent = 0, received = 0;
+        std::deque<Clock::time_point> inFlight;
+        std::string output, input;
+        char buffer[16384];
+        latencies[c].reserve(quota);
+
+        while (received < quota && !failed) {
+            output.clear();
+            while (sent < quota && inFlight.size() < depth) {
+                const std::pair<int, int>& pair = pairs[next++ % pairs.size()];
+                if (sent % 100 < recommendPercent) output += "recommend " + std::to_string(pair.first) + " " + std::to_string(recommendCount) + "\n";
+                else output += "predict " + std::to_string(pair.first) + " " + std::to_string(pair.second) + "\n";
+                inFlight.push_back(Clock::now());
+                sent++;
+            }
+            for (size_t offset = 0; offset < output.size();) {
+                ssize_t n = send(fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    failed = true;
+                    break;
+                }
+                offset += static_cast<size_t>(n);
+            }
+
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+            input.append(buffer, static_cast<size_t>(n));
+            size_t start = 0, end;
+            while ((end = input.find('\n', start)) != std::string::npos && !inFlight.empty()) {
+                std::chrono::duration<double, std::milli> latency = Clock::now() - inFlight.front();
+                latencies[c].push_back(latency.count());
+                inFlight.pop_front();
+                if (input.compare(start, 4, "err:") == 0) errors[c]++;
+                start = end + 1;
+                received++;
+            }
+            input.erase(0, start);
+        }
+        close(fd);
+    };
+
+    auto timerStart = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < numConnections; ++c) threads.emplace_back(client, c);
+    for (auto& thread : threads) thread.join();
+    std::chrono::duration<double> runTime = Clock::now() - timerStart;
+    if (failed) {
+        std::cerr << "err: connection-to-''" << address << "''-failed.\n";
+        return false;
+    }
+
+    std::vector<double> all;
+    size_t numErrors = 0;
+    for (size_t c = 0; c < numConnections; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        numErrors += errors[c];
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+    std::cout << "loadgen-requests: " << all.size() << " (" << numConnections << " connections, depth " << depth << ")\n"
+              << "loadgen-errors: " << numErrors << "\n"
+              << "loadgen-throughput: " << all.size() / runTime.count() << " requests/second\n"
+              << "loadgen-latency: p50 " << percentile(0.50) << " ms, p90 " << percentile(0.90) << " ms, p99 "
+              << percentile(0.99) << " ms, max " << all.back() << " ms" << std::endl;
+    return true;
+}
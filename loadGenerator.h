@@ -0,0 +1,32 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include "compactStore.h"
+
+#include <string>
+
+/*
+ * Load-generator client of RecommendationServer.
+ *
+ * Every connection runs on its own thread and keeps up to depth requests in flight, built from the
+ * (user, movie) pairs of a test store: predict requests, and a recommend request for every
+ * recommendPercent out of 100 requests. The latency of a request is measured from the moment it is
+ * queued for sending until its response line arrives.
+ */
+class LoadGenerator {
+public:
+	//Constructor.
+    LoadGenerator(size_t numConnections = 4, size_t depth = 16, size_t recommendPercent = 10, size_t recommendCount = 10);
+
+    /* Sends numRequests requests to the server at address and prints the throughput and the latency percentiles.
+    Returns false if a connection failed. */
+    bool run(const std::string& address, const CompactStore& testStore, size_t numRequests) const;
+
+private:
+    size_t numConnections;   //Number of client connections.
+    size_t depth;            //Requests in flight per connection.
+    size_t recommendPercent; //Share of recommend requests, out of 100.
+    size_t recommendCount;   //N of the recommend requests.
+};
+
+#endif // LOADGENERATOR_H
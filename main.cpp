@@ -1,28 +1,244 @@
-#include "DataHash2D.h"
-#include "Prediction.h"
+#include "pipeline.h"
+#include "memoryTracker.h"
 
+#include <iostream>
 #include <string>
+#include <stdexcept>
 #include <chrono>
+#include <cstdlib>
+#include <new>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+//Replaced global allocation functions for MemoryTracker. Blocks are counted with their usable size, so deallocation needs no size.
+void* operator new(size_t size) {
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    if (MemoryTracker::isEnabled()) MemoryTracker::recordAllocation(malloc_usable_size(p));
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p != nullptr && MemoryTracker::isEnabled()) MemoryTracker::recordAllocation(malloc_usable_size(p));
+    return p;
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+    if (p == nullptr) return;
+    if (MemoryTracker::isEnabled()) MemoryTracker::recordDeallocation(malloc_usable_size(p));
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    operator delete(p);
+}
+#endif
+
+//Prints the command line usage.
+void printUsage(const char* program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --train FILE              training ratings (default: datasets/public_training_data.txt)\n"
+              << "  --test FILE               test ratings to predict (default: datasets/public_test_data.txt)\n"
+              << "  --output FILE             predictions output (default: submission.txt)\n"
+              << "  --format auto|txt|csv|snapshot\n"
+              << "                            input format, auto picks it from the extension (default: auto)\n"
+              << "  --save-snapshot FILE      also save the training data as a binary snapshot\n"
+              << "  --neighbors FILE          load the neighbor lists from FILE if they were saved for the same data\n"
+              << "                            and settings, else build them and save them there\n"
+              << "  --algorithm ibcf|ubcf|hash-ibcf|hash-ubcf|walk\n"
+              << "                            prediction algorithm (default: ubcf)\n"
+              << "  --metric cosine|pearson|jaccard\n"
+              << "                            similarity metric of ibcf/ubcf (default: cosine)\n"
+              << "  --k N                     number of nearest neighbors (default: 27)\n"
+              << "  --baseline off|fallback|residual\n"
+              << "                            baseline predictor use: none, fallback for missing neighbors,\n"
+              << "                            or base of the neighbor residuals (default: fallback)\n"
+              << "  --walk-alpha A            walk edges with probability proportional to rating^A, 0 to 10 (default: 0.5)\n"
+              << "  --walk-restart P          walk restart probability after every round, 0 to 1 (default: 0.5)\n"
+              << "  --walk-steps N            step budget of a walk query (default: 20000)\n"
+              << "  --recommend USER          print the top recommendations of USER instead of predicting the test set (ibcf, ubcf, walk)\n"
+              << "  --count N                 number of recommendations (default: 10)\n"
+              << "  --shrinkage L             weight similarities by n / (n + L), n co-rated count (default: 0, off)\n"
+              << "  --min-overlap N           drop neighbors with fewer than N co-rated entries (default: 0, off)\n"
+              << "  --threads N               worker threads, at most the hardware concurrency (default: hardware concurrency)\n"
+              << "  --workers N               build neighbor lists with N worker processes (default: 0, in process)\n"
+              << "  --memory-budget MB        memory limit for the ibcf/ubcf model structures (default: unlimited)\n"
+              << "  --rating-bits 4|8         rating code width (default: 4)\n"
+              << "  --similarity-bits 8|16    similarity code width (default: 16)\n"
+              << "  --benchmark               compare the untiled and tiled similarity traversals and exit\n"
+              << "  --serve ADDRESS           serve predictions on PORT, HOST:PORT or a Unix socket path until interrupted\n"
+              << "  --batch-window US         time the server waits to coalesce requests (default: 200)\n"
+              << "  --loadgen ADDRESS         send test set requests to a running server and report latencies\n"
+              << "  --requests N              load generator requests (default: 100000)\n"
+              << "  --connections N           load generator connections (default: 4)\n"
+              << "  --depth N                 load generator requests in flight per connection (default: 16)\n"
+              << "  --track-memory            print the heap peak of every stage\n"
+              << "  --footprint RATINGS       report the bytes of every structure, projected to RATINGS ratings\n"
+              << "  --footprint-users N       users of the projection (default: the users of the training data)\n"
+              << "  --footprint-movies N      movies of the projection (default: the movies of the training data)\n"
+              << "  --help                    print this message\n";
+}
+
+//Fills config from the command line. Returns false on invalid arguments.
+bool parseArguments(int argc, char* argv[], PipelineConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--benchmark") { config.benchmark = true; continue; }
+        if (option == "--track-memory") { config.trackMemory = true; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "err: missing-value-for-" << option << ".\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        try {
+            if (option == "--train") config.trainFile = value;
+            else if (option == "--test") config.testFile = value;
+            else if (option == "--output") config.outputFile = value;
+            else if (option == "--save-snapshot") config.snapshotFile = value;
+            else if (option == "--neighbors") config.neighborsFile = value;
+            else if (option == "--k") config.k = std::stoi(value);
+            else if (option == "--threads") config.threads = std::stoul(value);
+            else if (option == "--workers") config.workers = std::stoul(value);
+            else if (option == "--shrinkage") config.similarityOptions.shrinkage = std::stof(value);
+            else if (option == "--min-overlap") config.similarityOptions.minOverlap = std::stoul(value);
+            else if (option == "--memory-budget") config.memoryBudgetMB = std::stoul(value);
+            else if (option == "--serve") config.serveAddress = value;
+            else if (option == "--batch-window") config.batchWindow = std::stoul(value);
+            else if (option == "--loadgen") config.loadAddress = value;
+            else if (option == "--requests") config.loadRequests = std::stoul(value);
+            else if (option == "--connections") config.loadConnections = std::stoul(value);
+            else if (option == "--depth") config.loadDepth = std::stoul(value);
+            else if (option == "--footprint") config.footprintRatings = std::stoul(value);
+            else if (option == "--walk-alpha") config.walkOptions.alpha = std::stof(value);
+            else if (option == "--walk-restart") config.walkOptions.restartProbability = std::stof(value);
+            else if (option == "--walk-steps") config.walkOptions.maxSteps = std::stoul(value);
+            else if (option == "--recommend") config.recommendUser = std::stoi(value);
+            else if (option == "--count") config.recommendCount = std::stoul(value);
+            else if (option == "--footprint-users") config.footprintUsers = std::stoul(value);
+            else if (option == "--footprint-movies") config.footprintMovies = std::stoul(value);
+            else if (option == "--format") {
+                if (value == "auto") config.format = InputFormat::Auto;
+                else if (value == "txt") config.format = InputFormat::TXT;
+                else if (value == "csv") config.format = InputFormat::CSV;
+                else if (value == "snapshot") config.format = InputFormat::Snapshot;
+                else throw std::invalid_argument(value);
+            } else if (option == "--algorithm") {
+                if (value == "ibcf") config.algorithm = Algorithm::IBCF;
+                else if (value == "ubcf") config.algorithm = Algorithm::UBCF;
+                else if (value == "hash-ibcf") config.algorithm = Algorithm::HashIBCF;
+                else if (value == "hash-ubcf") config.algorithm = Algorithm::HashUBCF;
+                else if (value == "walk") config.algorithm = Algorithm::Walk;
+                else throw std::invalid_argument(value);
+            } else if (option == "--metric") {
+                if (value == "cosine") config.similarityOptions.metric = SimilarityMetric::Cosine;
+                else if (value == "pearson") config.similarityOptions.metric = SimilarityMetric::Pearson;
+                else if (value == "jaccard") config.similarityOptions.metric = SimilarityMetric::Jaccard;
+                else throw std::invalid_argument(value);
+            } else if (option == "--baseline") {
+                if (value == "off") config.baselineMode = BaselineMode::Off;
+                else if (value == "fallback") config.baselineMode = BaselineMode::Fallback;
+                else if (value == "residual") config.baselineMode = BaselineMode::Residual;
+                else throw std::invalid_argument(value);
+            } else if (option == "--rating-bits") {
+                if (value == "4") config.ratingCodec = RatingCodec::Nibble;
+                else if (value == "8") config.ratingCodec = RatingCodec::Byte;
+                else throw std::invalid_argument(value);
+            } else if (option == "--similarity-bits") {
+                if (value == "8") config.similarityCodec = SimilarityCodec::Byte;
+                else if (value == "16") config.similarityCodec = SimilarityCodec::Short;
+                else throw std::invalid_argument(value);
+            } else {
+                std::cerr << "err: unknown-option-" << option << ".\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "err: invalid-value-''" << value << "''-for-" << option << ".\n";
+            return false;
+        }
+    }
+    if (config.k <= 0) {
+        std::cerr << "err: k-must-be-positive.\n";
+        return false;
+    }
+    //Edge weights are rating^alpha summed per node in floats, so alpha is kept where the sums stay finite and exact enough.
+    if (!(config.walkOptions.alpha >= 0.0f && config.walkOptions.alpha <= 10.0f)) {
+        std::cerr << "err: walk-alpha-must-be-between-0-and-10.\n";
+        return false;
+    }
+    if (!(config.walkOptions.restartProbability >= 0.0f && config.walkOptions.restartProbability <= 1.0f)) {
+        std::cerr << "err: walk-restart-must-be-between-0-and-1.\n";
+        return false;
+    }
+    if (config.recommendUser >= 0 && (config.algorithm == Algorithm::HashIBCF || config.algorithm == Algorithm::HashUBCF)) {
+        std::cerr << "err: recommend-needs-the-ibcf-ubcf-or-walk-algorithm.\n";
+        return false;
+    }
+    if (config.benchmark && (config.algorithm == Algorithm::HashIBCF || config.algorithm == Algorithm::HashUBCF)) {
+        std::cerr << "err: benchmark-needs-the-ibcf-ubcf-or-walk-algorithm.\n";
+        return false;
+    }
+    if (config.memoryBudgetMB > 0 && config.algorithm != Algorithm::IBCF && config.algorithm != Algorithm::UBCF) {
+        std::cerr << "err: memory-budget-needs-the-ibcf-or-ubcf-algorithm.\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        }
+    }
+#ifdef __GLIBC__
+    MemoryTracker::setAllocatorInstalled();
+#endif
+    PipelineConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
 
-using namespace std;
-int main() {
 	std::cout << "process-started..." << std::endl;
 	auto timerStart = std::chrono::high_resolution_clock::now(); //Timer: Start.
 
-	int kNearestNeighbors = 27;
-	string trainData = "datasets/public_training_data.txt"; //public_training_data.txt => The data set that used for the training purposes.
-	string testData = "datasets/public_test_data.txt"; //public_test_data.txt => Test data set that needs to be predicted.
-
-	Prediction prediction(trainData, testData); //Create an instance of Prediction class with training and test datasets.
-    DataHash2D predictions = prediction.runUBCF(kNearestNeighbors); //Run the IBCF method using kNearestNeighbors parameter.
-    
-    float rmse = prediction.RMSE(predictions); //Root Mean Square Error (RMSE) calculation.
-    std::cout << "\n*rmse: " << rmse << std::endl;
+    Pipeline pipeline(config);
+    int status = pipeline.run();
 
     auto timerEnd = std::chrono::high_resolution_clock::now(); //Timer: End.
     std::chrono::duration<double> runTime = timerEnd - timerStart;
     std::cout << "*runtime: " << runTime.count() << " seconds\n\n";
 
-	std::cout << "process-ended...\nresults-are-saved-to-submission.txt" << std::endl;
-    return 0;
+    bool isBatchRun = !config.benchmark && config.serveAddress.empty() && config.loadAddress.empty() && config.footprintRatings == 0
+                      && config.recommendUser < 0;
+    if (status == 0 && isBatchRun) std::cout << "process-ended...\nresults-are-saved-to-" << config.outputFile << std::endl;
+    else std::cout << "process-ended..." << std::endl;
+    return status;
 }
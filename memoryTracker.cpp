@@ -0,0 +1,70 @@
+#include "memoryTracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+std::atomic<bool> MemoryTracker::enabled(false);
+std::atomic<bool> MemoryTracker::allocatorInstalled(false);
+std::atomic<int64_t> MemoryTracker::currentBytes(0);
+std::atomic<int64_t> MemoryTracker::peakBytes(0);
+
+void MemoryTracker::enable() {
+    enabled.store(true);
+}
+
+void MemoryTracker::setAllocatorInstalled() {
+    allocatorInstalled.store(true);
+}
+
+bool MemoryTracker::isAvailable() {
+    return allocatorInstalled.load();
+}
+
+bool MemoryTracker::isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::getCurrentBytes() {
+    return static_cast<size_t>(std::max<int64_t>(currentBytes.load(), 0));
+}
+
+size_t MemoryTracker::getPeakBytes() {
+    return static_cast<size_t>(std::max<int64_t>(peakBytes.load(), 0));
+}
+
+void MemoryTracker::resetPeak() {
+    peakBytes.store(currentBytes.load());
+}
+
+void MemoryTracker::recordAllocation(size_t bytes) {
+    int64_t current = currentBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+    int64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (current > peak && !peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+}
+
+void MemoryTracker::recordDeallocation(size_t bytes) {
+    currentBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::heapBlockSize(size_t requestedBytes) {
+    //glibc chunks: 8-byte size header, 16-byte granularity, 32 bytes minimum.
+    return std::max<size_t>(32, (requestedBytes + sizeof(size_t) + 15) & ~static_cast<size_t>(15));
+}
+
+MemoryUsage MemoryTracker::ratingMapUsage(const std::unordered_map<int, std::unordered_map<int, float>>& map) {
+    typedef std::unordered_map<int, float> InnerMap;
+    //libstdc++ nodes: next pointer + value, int hashes are not cached. A map with one bucket does not allocate it.
+    const size_t outerNode = heapBlockSize(sizeof(void*) + sizeof(std::pair<const int, InnerMap>));
+    const size_t innerNode = heapBlockSize(sizeof(void*) + sizeof(std::pair<const int, float>));
+    auto bucketBytes = [](size_t bucketCount) { return bucketCount > 1 ? heapBlockSize(bucketCount * sizeof(void*)) : 0; };
+
+    MemoryUsage usage;
+    size_t total = sizeof(map) + bucketBytes(map.bucket_count()) + map.size() * outerNode;
+    for (const auto& entry : map) {
+        usage.payloadBytes += sizeof(int) + entry.second.size() * (sizeof(int) + sizeof(float));
+        total += bucketBytes(entry.second.bucket_count()) + entry.second.size() * innerNode;
+    }
+    usage.overheadBytes = total - usage.payloadBytes;
+    return usage;
+}
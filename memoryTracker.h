@@ -0,0 +1,75 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+//Bytes used by a data structure.
+struct MemoryUsage {
+    size_t payloadBytes = 0;  //Bytes of the ids and values themselves, as the structure stores them.
+    size_t overheadBytes = 0; //Everything else: indexes, hash buckets and nodes, padding, unused capacity.
+
+    //Returns payloadBytes + overheadBytes.
+    size_t getTotalBytes() const { return payloadBytes + overheadBytes; }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        payloadBytes += other.payloadBytes;
+        overheadBytes += other.overheadBytes;
+        return *this;
+    }
+};
+
+/*
+ * Process-wide heap accounting.
+ *
+ * The counting global operator new and delete are not part of the library, so linking it never changes the allocator:
+ * an executable that wants heap accounting replaces them in its own translation unit (main.cpp does on glibc, where
+ * malloc_usable_size gives the block sizes) and calls setAllocatorInstalled(). Once enable() is called, every heap block
+ * is counted with its usable size, so the current and peak heap bytes of the process are known at any time.
+ * resetPeak() starts a new peak window, which is how the pipeline measures the peak of every stage.
+ * Memory mapped snapshots are not heap memory and are not counted.
+ * Tracking is off by default; the disabled allocator costs one relaxed load per call.
+ */
+class MemoryTracker {
+public:
+    //Starts counting heap blocks. Blocks allocated before are not counted.
+    static void enable();
+
+    //Returns true once enable() has been called.
+    static bool isEnabled();
+
+    //Called by an executable whose operator new and delete call recordAllocation and recordDeallocation.
+    static void setAllocatorInstalled();
+
+    //Returns true if the counting allocator is installed. Without it the heap figures stay 0.
+    static bool isAvailable();
+
+    //Returns the heap bytes currently allocated.
+    static size_t getCurrentBytes();
+
+    //Returns the highest getCurrentBytes() since the last resetPeak().
+    static size_t getPeakBytes();
+
+    //Starts a new peak window at the current heap bytes.
+    static void resetPeak();
+
+    //Called by the replaced operator new and delete.
+    static void recordAllocation(size_t bytes);
+    static void recordDeallocation(size_t bytes);
+
+    //Returns the heap bytes taken by a block of requestedBytes, including the allocator header and rounding (glibc, 64-bit).
+    static size_t heapBlockSize(size_t requestedBytes);
+
+    //Returns the estimated bytes of a two-level hash map such as RatingMap, with hash nodes and buckets as overhead.
+    static MemoryUsage ratingMapUsage(const std::unordered_map<int, std::unordered_map<int, float>>& map);
+
+private:
+    static std::atomic<bool> enabled;
+    static std::atomic<bool> allocatorInstalled;
+    static std::atomic<int64_t> currentBytes; //Signed: blocks allocated before enable() may be freed after it.
+    static std::atomic<int64_t> peakBytes;
+};
+
+#endif // MEMORYTRACKER_H
@@ -0,0 +1,74 @@
+#include "neighborAggregator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+NeighborAggregator::NeighborAggregator() {}
+
+void NeighborAggregator::setUser(size_t rowCount, const std::vector<uint32_t>& rows, const std::vector<float>& values) {
+    if (rowValues.size() < rowCount) {
+        rowValues.resize(rowCount, 0.0f);
+        ratedBits.resize((rowCount + 63) / 64, 0);
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rowValues[rows[i]] = values[i];
+        ratedBits[rows[i] >> 6] |= uint64_t(1) << (rows[i] & 63);
+    }
+    loadedRows.assign(rows.begin(), rows.end());
+}
+
+void NeighborAggregator::clearUser() {
+    for (uint32_t row : loadedRows) {
+        rowValues[row] = 0.0f;
+        ratedBits[row >> 6] = 0;
+    }
+    loadedRows.clear();
+}
+
+void NeighborAggregator::aggregate(const CompactNeighbors& neighbors, const std::vector<long>& rows,
+                                   std::vector<float>& weightedSums, std::vector<float>& similaritySums) {
+    weightedSums.assign(rows.size(), 0.0f);
+    similaritySums.assign(rows.size(), 0.0f);
+    for (size_t r = 0; r < rows.size(); ++r) {
+        if (rows[r] < 0 || loadedRows.empty()) continue;
+        size_t count = neighbors.getCount(rows[r]);
+        if (weights.size() < count) {
+            weights.resize(count);
+            values.resize(count);
+        }
+        //Gather: unrated neighbors get a 0 weight, so the sums need no branches.
+        neighbors.decodeSimilarities(rows[r], weights.data());
+        const uint32_t* neighborRows = neighbors.getNeighborRow(rows[r]);
+        for (size_t n = 0; n < count; ++n) {
+            uint32_t neighborRow = neighborRows[n];
+            weights[n] *= static_cast<float>((ratedBits[neighborRow >> 6] >> (neighborRow & 63)) & 1);
+            values[n] = rowValues[neighborRow];
+        }
+        dotSums(weights.data(), values.data(), count, weightedSums[r], similaritySums[r]);
+    }
+}
+
+void NeighborAggregator::dotSums(const float* weights, const float* values, size_t count, float& weightedSum, float& weightSum) {
+    size_t i = 0;
+    weightedSum = 0.0f;
+    weightSum = 0.0f;
+#ifdef __SSE2__
+    __m128 weighted = _mm_setzero_ps();
+    __m128 total = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 w = _mm_loadu_ps(weights + i);
+        weighted = _mm_add_ps(weighted, _mm_mul_ps(w, _mm_loadu_ps(values + i)));
+        total = _mm_add_ps(total, w);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, weighted);
+    weightedSum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, total);
+    weightSum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < count; ++i) {
+        weightedSum += weights[i] * values[i];
+        weightSum += weights[i];
+    }
+}
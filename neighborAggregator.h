@@ -0,0 +1,48 @@
+#ifndef NEIGHBORAGGREGATOR_H
+#define NEIGHBORAGGREGATOR_H
+
+#include "compactNeighbors.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Batched neighbor aggregation kernel of IBCF.
+ *
+ * The ratings of one user are loaded once into a dense array indexed by neighbor row, with a bitmap of the rated rows.
+ * Aggregating a movie then gathers the ratings of its K neighbors with one bitmap probe each, and computes the
+ * similarity-weighted rating sum and the similarity sum of the rated neighbors with SSE2 (scalar without SSE2).
+ * Loading and clearing a user costs its number of ratings, so one aggregator serves any number of users and
+ * all the test movies of a user are aggregated in one call.
+ */
+class NeighborAggregator {
+public:
+	//Constructor.
+    NeighborAggregator();
+
+    /* Loads the values of a user: values[i] is the rating (or residual) of neighbor row rows[i].
+    rowCount is the number of rows of the neighbor lists. */
+    void setUser(size_t rowCount, const std::vector<uint32_t>& rows, const std::vector<float>& values);
+
+    //Removes the loaded user.
+    void clearUser();
+
+    /* Aggregates the neighbors of every row in rows with the loaded user, in the same order.
+    weightedSums gets the similarity-weighted sum of the rated neighbor values, similaritySums the sum of
+    their similarities. Rows of -1 get 0 sums. */
+    void aggregate(const CompactNeighbors& neighbors, const std::vector<long>& rows,
+                   std::vector<float>& weightedSums, std::vector<float>& similaritySums);
+
+    //Returns sum(weights[i] * values[i]) in weightedSum and sum(weights[i]) in weightSum.
+    static void dotSums(const float* weights, const float* values, size_t count, float& weightedSum, float& weightSum);
+
+private:
+    std::vector<float> rowValues;   //Value of every row of the loaded user, 0 if not rated.
+    std::vector<uint64_t> ratedBits; //Bitmap of the rated rows.
+    std::vector<uint32_t> loadedRows; //Rows set by setUser, cleared by clearUser.
+    std::vector<float> weights;      //Gathered similarities, 0 for unrated neighbors.
+    std::vector<float> values;       //Gathered values.
+};
+
+#endif // NEIGHBORAGGREGATOR_H
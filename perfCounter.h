@@ -0,0 +1,36 @@
+#ifndef PERFCOUNTER_H
+#define PERFCOUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Hardware cache-miss counter of the calling process, threads started after start() included.
+ * Uses perf_event_open on Linux. Where perf counters are not available (other systems, containers,
+ * perf_event_paranoid restrictions) isAvailable() returns false and the counter reads 0.
+ */
+class PerfCounter {
+public:
+	//Constructor. Opens the counter, disabled.
+    PerfCounter();
+    
+    //Destructor. Closes the counter.
+    ~PerfCounter();
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    //Resets and enables the counter.
+    void start();
+
+    //Disables the counter and returns the number of cache misses since start().
+    uint64_t stop();
+
+    //Returns true if the counter could be opened.
+    bool isAvailable() const;
+
+private:
+    int fd; //perf event file descriptor, -1 if not available.
+};
+
+#endif // PERFCOUNTER_H
@@ -0,0 +1,548 @@
+#include "pipeline.h"
+#include "blockingQueue.h"
+#include "benchmark.h"
+#include "compactModel.h"
+#include "fileHandler.h"
+#include "loadGenerator.h"
+#include "memoryTracker.h"
+#include "prediction.h"
+#include "randomWalk.h"
+#include "recommendationServer.h"
+#include "shardedBuild.h"
+#include "threadHandler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+//One predicted test rating on its way to the writer thread.
+struct PredictionRecord {
+    int userId;
+    int movieId;
+    float predicted;
+    float actual;
+};
+
+//Returns the start time of a stage and starts its heap peak window.
+std::chrono::high_resolution_clock::time_point startStage() {
+    MemoryTracker::resetPeak();
+    return std::chrono::high_resolution_clock::now();
+}
+
+//Prints the time spent in a stage, and its heap peak when memory is tracked.
+void printStage(const std::string& name, std::chrono::high_resolution_clock::time_point start) {
+    std::chrono::duration<double> stageTime = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "stage-" << name << ": " << stageTime.count() << " seconds";
+    if (MemoryTracker::isEnabled()) std::cout << ", peak-heap: " << MemoryTracker::getPeakBytes() / (1024.0 * 1024.0) << " MiB";
+    std::cout << "\n";
+}
+
+//One measured structure of the footprint report.
+struct FootprintEntry {
+    std::string name;
+    MemoryUsage usage;     //Reported by the structure.
+    size_t heapBytes;      //Heap growth measured by the tracker while the structure was built.
+    std::string unit;      //What the structure grows with.
+    double units;          //Units in the measured data.
+    double projectedUnits; //Units at the target scale.
+
+    double getProjectedBytes() const { return units > 0 ? usage.getTotalBytes() / units * projectedUnits : 0.0; }
+};
+
+double toMiB(double bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+RecommendationServer* activeServer = nullptr; //Server stopped by SIGINT and SIGTERM.
+
+void stopServer(int) {
+    if (activeServer != nullptr) activeServer->stop();
+}
+}
+
+Pipeline::Pipeline(const PipelineConfig& config) : config(config) {}
+
+InputFormat Pipeline::formatOf(const std::string& fileName) const {
+    if (config.format != InputFormat::Auto) return config.format;
+    if (endsWith(fileName, ".csv")) return InputFormat::CSV;
+    if (endsWith(fileName, ".bin") || endsWith(fileName, ".snapshot")) return InputFormat::Snapshot;
+    return InputFormat::TXT;
+}
+
+DataHash2D Pipeline::loadDataHash(const std::string& fileName) const {
+    FileHandler fileHandler;
+    switch (formatOf(fileName)) {
+    case InputFormat::CSV: return fileHandler.readFromCSV(fileName);
+    case InputFormat::Snapshot: return CompactStore::loadSnapshot(fileName).toDataHash2D();
+    default: return fileHandler.readFromTXT(fileName);
+    }
+}
+
+CompactStore Pipeline::loadStore(const std::string& fileName, bool isMovieBased) const {
+    if (formatOf(fileName) == InputFormat::Snapshot) {
+        CompactStore store = CompactStore::loadSnapshot(fileName);
+        return store.isMovieBased() == isMovieBased ? store : store.transpose();
+    }
+    return CompactStore(loadDataHash(fileName), isMovieBased, config.ratingCodec);
+}
+
+bool Pipeline::fitMemoryBudget(const CompactStore& rowStore, const CompactStore& columnStore, const CompactStore& testStore) {
+    if (config.memoryBudgetMB == 0) return true;
+    size_t budget = config.memoryBudgetMB * 1024 * 1024;
+    size_t storeBytes = rowStore.getByteSize() + columnStore.getByteSize() + testStore.getByteSize();
+    auto neighborBytes = [&](SimilarityCodec codec) {
+        size_t codeBytes = (codec == SimilarityCodec::Byte) ? 1 : 2;
+        size_t capacity = CompactNeighbors::capacityFor(rowStore.getRowCount(), config.k);
+        return rowStore.getRowCount() * (sizeof(uint32_t) + capacity * (sizeof(uint32_t) + codeBytes));
+    };
+
+    if (storeBytes + neighborBytes(config.similarityCodec) <= budget) return true;
+    if (config.similarityCodec == SimilarityCodec::Short && storeBytes + neighborBytes(SimilarityCodec::Byte) <= budget) {
+        std::cout << "memory-budget: using-8-bit-similarities.\n";
+        config.similarityCodec = SimilarityCodec::Byte;
+        return true;
+    }
+    std::cerr << "err: estimated-model-size-" << (storeBytes + neighborBytes(SimilarityCodec::Byte))
+              << "-bytes-exceeds-the-memory-budget-of-" << budget << "-bytes.\n";
+    return false;
+}
+
+uint64_t Pipeline::neighborsKey(const CompactStore& rowStore) const {
+    //FNV-1a over the settings and the whole image of the store, so any change of a row id, column or rating changes it.
+    uint64_t key = 14695981039346656037ULL;
+    auto mix = [&key](uint64_t value) {
+        for (int b = 0; b < 8; ++b) {
+            key ^= (value >> (8 * b)) & 0xFF;
+            key *= 1099511628211ULL;
+        }
+    };
+    float shrinkage = config.similarityOptions.shrinkage;
+    uint32_t shrinkageBits;
+    std::memcpy(&shrinkageBits, &shrinkage, sizeof(shrinkageBits));
+    mix(static_cast<uint64_t>(config.k));
+    mix(static_cast<uint64_t>(config.similarityCodec));
+    mix(static_cast<uint64_t>(config.similarityOptions.metric));
+    mix(config.similarityOptions.minOverlap);
+    mix(shrinkageBits);
+    mix(rowStore.getByteSize());
+    const uint8_t* image = rowStore.getImage();
+    for (size_t b = 0; b < rowStore.getByteSize(); ++b) {
+        key ^= image[b];
+        key *= 1099511628211ULL;
+    }
+    return key;
+}
+
+bool Pipeline::buildNeighbors(const CompactStore& rowStore, CompactNeighbors& neighbors) const {
+    uint64_t key = 0;
+    if (!config.neighborsFile.empty()) {
+        key = neighborsKey(rowStore);
+        if (neighbors.loadSnapshot(config.neighborsFile, key)) {
+            std::cout << "neighbors-loaded-from-" << config.neighborsFile << "\n";
+            return true;
+        }
+    }
+
+    if (config.workers > 0) {
+        char snapshotFile[] = "/tmp/movie-recommendation-snapshot-XXXXXX";
+        int fd = mkstemp(snapshotFile);
+        if (fd < 0) {
+            std::cerr << "err: could-not-create-temporary-snapshot.\n";
+            return false;
+        }
+        close(fd);
+        if (!rowStore.saveSnapshot(snapshotFile)) return false;
+        //The test loader and the thread pools are joined by now, so the workers are forked from a single thread.
+        ShardedBuild shardedBuild(config.workers);
+        bool built = shardedBuild.run(snapshotFile, config.k, neighbors, config.similarityCodec, config.similarityOptions);
+        unlink(snapshotFile);
+        if (!built) return false;
+    } else {
+        Similarity sm;
+        neighbors = sm.tiledNeighborLists(rowStore, config.k, config.similarityCodec, 0, config.similarityOptions);
+    }
+    if (!config.neighborsFile.empty()) {
+        if (!neighbors.saveSnapshot(config.neighborsFile, key)) return false;
+        std::cout << "neighbors-saved-to-" << config.neighborsFile << "\n";
+    }
+    return true;
+}
+
+void Pipeline::fitBaseline(CompactModel& model) const {
+    if (config.baselineMode == BaselineMode::Off) return;
+    BaselinePredictor baseline;
+    if (model.isMovieBased()) baseline.fit(model.getRowStore(), model.getColumnStore());
+    else baseline.fit(model.getColumnStore(), model.getRowStore());
+    model.setBaseline(baseline, config.baselineMode);
+}
+
+int Pipeline::serve() {
+    if (config.algorithm != Algorithm::IBCF && config.algorithm != Algorithm::UBCF) {
+        std::cerr << "err: the-server-needs-the-ibcf-or-ubcf-algorithm.\n";
+        return 1;
+    }
+    auto stageStart = startStage();
+    CompactStore rowStore = loadStore(config.trainFile, config.algorithm == Algorithm::IBCF);
+    CompactStore columnStore = rowStore.transpose();
+    printStage("load", stageStart);
+    if (rowStore.getRowCount() == 0) {
+        std::cerr << "err: training-data-is-empty.\n";
+        return 1;
+    }
+    if (!fitMemoryBudget(rowStore, columnStore, CompactStore())) return 1; //The server keeps no test set.
+
+    stageStart = startStage();
+    CompactNeighbors neighbors;
+    if (!buildNeighbors(rowStore, neighbors)) return 1;
+    CompactModel model(rowStore, columnStore, neighbors);
+    fitBaseline(model);
+    printStage("neighbors", stageStart);
+
+    RecommendationServer server(model, config.threads, config.batchWindow);
+    activeServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    bool isServed = server.run(config.serveAddress);
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    activeServer = nullptr;
+    return isServed ? 0 : 1;
+}
+
+int Pipeline::runLoadGenerator() {
+    CompactStore testStore = loadStore(config.testFile, false);
+    LoadGenerator loadGenerator(config.loadConnections, config.loadDepth);
+    return loadGenerator.run(config.loadAddress, testStore, config.loadRequests) ? 0 : 1;
+}
+
+int Pipeline::runFootprint() {
+    std::vector<FootprintEntry> entries;
+    size_t heapBytes = MemoryTracker::getCurrentBytes();
+    //Returns the heap growth since the last call.
+    auto heapDelta = [&]() {
+        size_t current = MemoryTracker::getCurrentBytes();
+        size_t delta = current > heapBytes ? current - heapBytes : 0;
+        heapBytes = current;
+        return delta;
+    };
+
+    auto stageStart = startStage();
+    DataHash2D testData = loadDataHash(config.testFile);
+    heapDelta();
+    DataHash2D trainData = loadDataHash(config.trainFile);
+    size_t trainHeap = heapDelta();
+    printStage("load", stageStart);
+
+    double ratings = static_cast<double>(trainData.getDatasetSize());
+    double movies = static_cast<double>(trainData.getMovieCount());
+    double users = static_cast<double>(trainData.getUserCount());
+    if (ratings == 0 || testData.getDatasetSize() == 0) {
+        std::cerr << "err: training-or-test-data-is-empty.\n";
+        return 1;
+    }
+    //Entity counts not given keep their measured values: catalogs grow far slower than ratings, so scaling them with
+    //the ratings would blow up every per-entity and per-pair projection.
+    double scale = config.footprintRatings / ratings;
+    double targetRatings = static_cast<double>(config.footprintRatings);
+    double targetMovies = config.footprintMovies > 0 ? static_cast<double>(config.footprintMovies) : movies;
+    double targetUsers = config.footprintUsers > 0 ? static_cast<double>(config.footprintUsers) : users;
+    if (targetRatings > targetMovies * targetUsers) {
+        std::cerr << "err: " << config.footprintRatings << "-ratings-do-not-fit-" << targetUsers << "-users-times-"
+                  << targetMovies << "-movies-set-footprint-users-and-footprint-movies.\n";
+        return 1;
+    }
+    entries.push_back({ "DataHash2D train", trainData.getMemoryUsage(), trainHeap, "rating", ratings, targetRatings });
+
+    //Compact stores of both codecs, movie rows and user rows.
+    stageStart = startStage();
+    CompactStore movieStores[2], userStores[2];
+    const RatingCodec ratingCodecs[2] = { RatingCodec::Nibble, RatingCodec::Byte };
+    for (int c = 0; c < 2; ++c) {
+        std::string bits = (c == 0) ? "4-bit" : "8-bit";
+        heapDelta();
+        movieStores[c] = CompactStore(trainData, true, ratingCodecs[c]);
+        entries.push_back({ "CompactStore " + bits + " movie rows", movieStores[c].getMemoryUsage(), heapDelta(), "rating", ratings, targetRatings });
+        userStores[c] = movieStores[c].transpose();
+        entries.push_back({ "CompactStore " + bits + " user rows", userStores[c].getMemoryUsage(), heapDelta(), "rating", ratings, targetRatings });
+    }
+    //The walk graph on top of the 4-bit stores, which it shares.
+    heapDelta();
+    {
+        RandomWalk walk(movieStores[0], userStores[0], config.walkOptions);
+        entries.push_back({ "RandomWalk graph", walk.getMemoryUsage(), heapDelta(), "rating", ratings, targetRatings });
+    }
+    printStage("compact", stageStart);
+
+    //Neighbor lists of both codecs for IBCF and UBCF. Rows keep the measured share of their k slots at the target scale.
+    stageStart = startStage();
+    Similarity sm;
+    const SimilarityCodec similarityCodecs[2] = { SimilarityCodec::Byte, SimilarityCodec::Short };
+    CompactNeighbors movieNeighbors;
+    for (int c = 0; c < 2; ++c) {
+        std::string bits = (c == 0) ? "8-bit" : "16-bit";
+        for (int side = 0; side < 2; ++side) {
+            const CompactStore& store = (side == 0) ? movieStores[0] : userStores[0];
+            double rows = (side == 0) ? movies : users;
+            double targetRows = (side == 0) ? targetMovies : targetUsers;
+            heapDelta();
+            CompactNeighbors neighbors = sm.tiledNeighborLists(store, config.k, similarityCodecs[c], 0, config.similarityOptions);
+            double slots = rows * std::min<double>(config.k, rows - 1);
+            double fill = slots > 0 ? neighbors.getNeighborCount() / slots : 0.0;
+            entries.push_back({ "CompactNeighbors " + bits + ((side == 0) ? " movies" : " users"), neighbors.getMemoryUsage(), heapDelta(),
+                                "neighbor", static_cast<double>(neighbors.getNeighborCount()),
+                                targetRows * std::min<double>(config.k, targetRows - 1) * fill });
+            if (side == 0 && similarityCodecs[c] == SimilarityCodec::Short) movieNeighbors = neighbors;
+        }
+    }
+    printStage("neighbors", stageStart);
+
+    //Full similarity maps of the hash algorithms. Stored pairs grow with the square of the entity count.
+    stageStart = startStage();
+    for (int side = 0; side < 2; ++side) {
+        double rows = (side == 0) ? movies : users;
+        double targetRows = (side == 0) ? targetMovies : targetUsers;
+        heapDelta();
+        RatingMap matrix = sm.similarityMatrix(side == 0, trainData, config.similarityOptions);
+        MemoryUsage usage = MemoryTracker::ratingMapUsage(matrix);
+        double pairs = 0;
+        for (const auto& row : matrix) pairs += row.second.size();
+        double projectedPairs = std::min(pairs * (targetRows / rows) * (targetRows / rows), targetRows * (targetRows - 1));
+        entries.push_back({ std::string("similarity RatingMap ") + ((side == 0) ? "movies" : "users"), usage, heapDelta(), "pair", pairs, projectedPairs });
+    }
+    printStage("similarity-maps", stageStart);
+
+    //Predictions of the test set, kept in a DataHash2D as the hash algorithms return them.
+    stageStart = startStage();
+    CompactModel model(movieStores[0], userStores[0], movieNeighbors);
+    BaselinePredictor baseline;
+    baseline.fit(movieStores[0], userStores[0]);
+    if (config.baselineMode != BaselineMode::Off) model.setBaseline(baseline, config.baselineMode);
+    entries.push_back({ "BaselinePredictor", baseline.getMemoryUsage(), 0, "entity", movies + users, targetMovies + targetUsers });
+    CompactStore testStore(testData, false, RatingCodec::Byte);
+    heapDelta();
+    DataHash2D predictions;
+    std::vector<int> testMovies;
+    std::vector<float> actual, predicted;
+    for (size_t u = 0; u < testStore.getRowCount(); ++u) {
+        int userId = testStore.getRowId(u);
+        testStore.decodeRow(u, testMovies, actual);
+        model.predictUser(userId, testMovies, predicted);
+        for (size_t m = 0; m < testMovies.size(); ++m) {
+            if (predicted[m] >= 0.0f) predictions.addRating(testMovies[m], userId, predicted[m]);
+        }
+    }
+    double numPredictions = static_cast<double>(predictions.getDatasetSize());
+    entries.push_back({ "DataHash2D predictions", predictions.getMemoryUsage(), heapDelta(), "prediction", numPredictions, numPredictions * scale });
+    printStage("predict", stageStart);
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(2)
+              << "\nfootprint: measured on " << static_cast<size_t>(ratings) << " ratings, " << static_cast<size_t>(users) << " users, "
+              << static_cast<size_t>(movies) << " movies, k = " << config.k
+              << "\nfootprint: projected to " << static_cast<size_t>(targetRatings) << " ratings, " << static_cast<size_t>(targetUsers)
+              << " users, " << static_cast<size_t>(targetMovies) << " movies\n\n"
+              << std::left << std::setw(32) << "structure" << std::right << std::setw(12) << "total-MiB" << std::setw(12) << "payload-MiB"
+              << std::setw(13) << "overhead-MiB" << std::setw(10) << "heap-MiB" << std::setw(12) << "unit"
+              << std::setw(12) << "bytes/unit" << std::setw(16) << "projected-MiB" << "\n";
+    for (const auto& e : entries) {
+        std::cout << std::left << std::setw(32) << e.name << std::right << std::setw(12) << toMiB(e.usage.getTotalBytes())
+                  << std::setw(12) << toMiB(e.usage.payloadBytes) << std::setw(13) << toMiB(e.usage.overheadBytes)
+                  << std::setw(10) << toMiB(e.heapBytes) << std::setw(12) << e.unit
+                  << std::setw(12) << (e.units > 0 ? e.usage.getTotalBytes() / e.units : 0.0)
+                  << std::setw(16) << toMiB(e.getProjectedBytes()) << "\n";
+    }
+
+    //Projected totals of every algorithm and encoding choice.
+    auto projected = [&](const std::string& name) {
+        for (const auto& e : entries) if (e.name == name) return e.getProjectedBytes();
+        return 0.0;
+    };
+    double baselineBytes = (config.baselineMode == BaselineMode::Off) ? 0.0 : projected("BaselinePredictor");
+    std::cout << "\nprojected-model-size:\n";
+    std::cout << "  hash-ibcf: " << toMiB(projected("DataHash2D train") + projected("similarity RatingMap movies") + projected("DataHash2D predictions")) << " MiB\n";
+    std::cout << "  hash-ubcf: " << toMiB(projected("DataHash2D train") + projected("similarity RatingMap users") + projected("DataHash2D predictions")) << " MiB\n";
+    for (const std::string algorithm : { "ibcf", "ubcf" }) {
+        for (const std::string ratingBits : { "4-bit", "8-bit" }) {
+            for (const std::string similarityBits : { "8-bit", "16-bit" }) {
+                double bytes = projected("CompactStore " + ratingBits + " movie rows") + projected("CompactStore " + ratingBits + " user rows")
+                             + projected("CompactNeighbors " + similarityBits + (algorithm == "ibcf" ? " movies" : " users")) + baselineBytes;
+                std::cout << "  " << algorithm << " --rating-bits " << ratingBits.substr(0, 1) << " --similarity-bits "
+                          << similarityBits.substr(0, similarityBits.find('-')) << ": " << toMiB(bytes) << " MiB\n";
+            }
+        }
+    }
+    std::cout.flags(flags);
+    return 0;
+}
+
+int Pipeline::runHash() {
+    auto stageStart = startStage();
+    DataHash2D trainData, testData;
+    std::thread testLoader([&]() { testData = loadDataHash(config.testFile); });
+    trainData = loadDataHash(config.trainFile);
+    testLoader.join();
+    printStage("load", stageStart);
+
+    stageStart = startStage();
+    Prediction prediction(trainData, testData);
+    prediction.setSimilarityOptions(config.similarityOptions);
+    prediction.setBaselineMode(config.baselineMode);
+    DataHash2D predictions = (config.algorithm == Algorithm::HashIBCF) ? prediction.runIBCF(config.k, config.outputFile)
+                                                                       : prediction.runUBCF(config.k, config.outputFile);
+    printStage("predict", stageStart);
+    try {
+        std::cout << "\n*rmse: " << prediction.RMSE(predictions) << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int Pipeline::run() {
+    if (config.threads > 0) ThreadHandler::setDefaultThreadCount(config.threads);
+    if (config.trackMemory || config.footprintRatings > 0) {
+        if (!MemoryTracker::isAvailable()) std::cerr << "err: heap-tracking-is-not-available-measured-bytes-are-0.\n";
+        MemoryTracker::enable();
+    }
+    if (config.footprintRatings > 0) return runFootprint();
+    if (!config.loadAddress.empty()) return runLoadGenerator();
+    if (!config.serveAddress.empty()) return serve();
+    if (config.algorithm == Algorithm::HashIBCF || config.algorithm == Algorithm::HashUBCF) return runHash();
+    bool isMovieBased = (config.algorithm == Algorithm::IBCF || config.algorithm == Algorithm::Walk);
+
+    //Stage 1: The test set is loaded and encoded while the training set is loaded and indexed.
+    auto stageStart = startStage();
+    CompactStore rowStore, columnStore, testStore;
+    std::thread testLoader([&]() { testStore = loadStore(config.testFile, false); });
+    rowStore = loadStore(config.trainFile, isMovieBased);
+    columnStore = rowStore.transpose();
+    testLoader.join();
+    printStage("load", stageStart);
+
+    if (rowStore.getRowCount() == 0 || testStore.getRowCount() == 0) {
+        std::cerr << "err: training-or-test-data-is-empty.\n";
+        return 1;
+    }
+    if (!config.snapshotFile.empty()) {
+        const CompactStore& movieStore = rowStore.isMovieBased() ? rowStore : columnStore;
+        if (!movieStore.saveSnapshot(config.snapshotFile)) return 1;
+    }
+    if (config.benchmark) {
+        Benchmark benchmark;
+        benchmark.similarityTraversal(rowStore, config.k, config.similarityCodec, 0, config.similarityOptions);
+        if (config.algorithm == Algorithm::IBCF) {
+            CompactModel model(rowStore, columnStore, Similarity().tiledNeighborLists(rowStore, config.k, config.similarityCodec, 0,
+                                                                                       config.similarityOptions));
+            fitBaseline(model);
+            benchmark.ibcfAggregation(model, testStore);
+        }
+        return 0;
+    }
+    std::unique_ptr<CompactModel> model;
+    std::unique_ptr<RandomWalk> walk;
+    if (config.algorithm == Algorithm::Walk) {
+        //Stage 2: Bipartite rating graph, nothing to precompute beyond it.
+        stageStart = startStage();
+        walk.reset(new RandomWalk(rowStore, columnStore, config.walkOptions));
+        if (config.baselineMode != BaselineMode::Off) {
+            BaselinePredictor baseline;
+            baseline.fit(rowStore, columnStore);
+            walk->setBaseline(baseline, config.baselineMode);
+        }
+        printStage("graph", stageStart);
+    } else {
+        if (!fitMemoryBudget(rowStore, columnStore, testStore)) return 1;
+
+        //Stage 2: Neighbor lists.
+        stageStart = startStage();
+        CompactNeighbors neighbors;
+        if (!buildNeighbors(rowStore, neighbors)) return 1;
+        model.reset(new CompactModel(rowStore, columnStore, neighbors));
+        fitBaseline(*model);
+        printStage("neighbors", stageStart);
+    }
+
+    if (config.recommendUser >= 0) {
+        std::vector<std::pair<int, float>> recommendations;
+        if (walk) walk->recommend(config.recommendUser, config.recommendCount, recommendations);
+        else model->recommend(config.recommendUser, config.recommendCount, recommendations);
+        std::cout << "recommendations-for-" << config.recommendUser << ":";
+        for (const auto& r : recommendations) std::cout << " " << r.first << ":" << r.second;
+        std::cout << std::endl;
+        return 0;
+    }
+    return predictTestSet(testStore, [&](int userId, const std::vector<int>& movieIds, std::vector<float>& predictions) {
+        if (walk) walk->predictUser(userId, movieIds, predictions);
+        else model->predictUser(userId, movieIds, predictions);
+    });
+}
+
+int Pipeline::predictTestSet(const CompactStore& testStore, const UserPredictor& predictUser) {
+    //Stage 3: Predictions are written and scored by the writer thread while the pool keeps predicting.
+    auto stageStart = startStage();
+    std::ofstream outfile(config.outputFile);
+    if (!outfile.is_open()) {
+        std::cerr << "err: could-not-open-file-for-writing-''" << config.outputFile << "''\n";
+        return 1;
+    }
+    BlockingQueue<std::vector<PredictionRecord>> results(256);
+    double squaredError = 0.0;
+    size_t numPredictions = 0;
+    std::thread writer([&]() {
+        std::vector<PredictionRecord> batch;
+        while (results.pop(batch)) {
+            for (const auto& r : batch) {
+                if (r.predicted < 0.0f) continue; //No prediction possible for this pair.
+                outfile << r.userId << " " << r.movieId << " " << r.predicted << "\n";
+                double error = r.actual - r.predicted;
+                squaredError += error * error;
+                numPredictions++;
+            }
+        }
+    });
+
+    const size_t usersPerTask = 64;
+    size_t numUsers = testStore.getRowCount();
+    ThreadHandler th;
+    auto predictUsers = [&](size_t task) {
+        std::vector<PredictionRecord> batch;
+        std::vector<int> movies;
+        std::vector<float> actual, predicted;
+        for (size_t u = task * usersPerTask; u < std::min((task + 1) * usersPerTask, numUsers); ++u) {
+            int userId = testStore.getRowId(u);
+            testStore.decodeRow(u, movies, actual);
+            predictUser(userId, movies, predicted);
+            for (size_t m = 0; m < movies.size(); ++m) batch.push_back({ userId, movies[m], predicted[m], actual[m] });
+        }
+        results.push(std::move(batch));
+    };
+    th.runTasks(predictUsers, (numUsers + usersPerTask - 1) / usersPerTask);
+    results.close();
+    writer.join();
+    outfile.close();
+    printStage("predict", stageStart);
+
+    if (numPredictions == 0) {
+        std::cerr << "err: no-predictions-found-to-calculate-RMSE.\n";
+        return 1;
+    }
+    std::cout << "\n*rmse: " << std::sqrt(squaredError / numPredictions) << std::endl;
+    return 0;
+}
@@ -0,0 +1,127 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "compactStore.h"
+#include "compactNeighbors.h"
+#include "similarity.h"
+#include "baselinePredictor.h"
+#include "compactModel.h"
+#include "randomWalk.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//Format of an input file.
+enum class InputFormat {
+    Auto,    //Picked from the file extension: .csv, .bin / .snapshot, anything else is TXT.
+    TXT,     //"userId movieId rating" lines after a header line.
+    CSV,     //"userId,movieId,rating" lines after a header line.
+    Snapshot //Binary CompactStore snapshot.
+};
+
+//Prediction algorithm.
+enum class Algorithm {
+    IBCF,     //Item-based CF on compact encodings.
+    UBCF,     //User-based CF on compact encodings.
+    HashIBCF, //Item-based CF on DataHash2D (Prediction::runIBCF).
+    HashUBCF, //User-based CF on DataHash2D (Prediction::runUBCF).
+    Walk      //Random walks on the bipartite rating graph (RandomWalk).
+};
+
+/* Settings of a pipeline run. Defaults run UBCF with k = 27 on the original files, but on the compact encodings and
+with the Fallback baseline; pairs without a prediction are left out of the output. */
+struct PipelineConfig {
+    std::string trainFile = "datasets/public_training_data.txt";
+    std::string testFile = "datasets/public_test_data.txt";
+    std::string outputFile = "submission.txt";
+    std::string snapshotFile;        //If not empty, the training data is also saved here as a snapshot.
+    std::string neighborsFile;       //If not empty, neighbor lists are loaded from here if they match, else built and saved here.
+    InputFormat format = InputFormat::Auto;
+    Algorithm algorithm = Algorithm::UBCF;
+    SimilarityOptions similarityOptions;  //Metric, shrinkage and minimum co-rated count of the neighbors.
+    RatingCodec ratingCodec = RatingCodec::Nibble;
+    SimilarityCodec similarityCodec = SimilarityCodec::Short;
+    int k = 27;
+    BaselineMode baselineMode = BaselineMode::Fallback; //Use of the baseline predictor.
+    RandomWalkOptions walkOptions;   //Settings of Algorithm::Walk.
+    int recommendUser = -1;          //If not -1, prints the recommendations of this user instead of predicting the test set.
+    size_t recommendCount = 10;      //Number of recommendations.
+    size_t threads = 0;              //Worker threads, 0: hardware concurrency.
+    size_t workers = 0;              //Worker processes for the neighbor build, 0: built in this process.
+    size_t memoryBudgetMB = 0;       //Upper limit for the model structures, 0: unlimited.
+    bool benchmark = false;          //Runs the similarity traversal benchmark instead of predicting.
+    std::string serveAddress;        //If not empty, serves the model on this address instead of predicting the test set.
+    size_t batchWindow = 200;        //Time the server waits to coalesce requests, in microseconds.
+    std::string loadAddress;         //If not empty, sends test set requests to the server on this address instead.
+    size_t loadRequests = 100000;    //Requests sent by the load generator.
+    size_t loadConnections = 4;      //Load generator connections.
+    size_t loadDepth = 16;           //Requests in flight per load generator connection.
+    bool trackMemory = false;        //Counts heap allocations and prints the heap peak of every stage.
+    size_t footprintRatings = 0;     //If not 0, prints the memory footprint report projected to this many ratings instead.
+    size_t footprintUsers = 0;       //Users of the projection, 0: the measured user count.
+    size_t footprintMovies = 0;      //Movies of the projection, 0: the measured movie count.
+};
+
+/*
+ * Runs a recommendation job as a sequence of overlapping stages:
+ * 1. Load and index: the training file is loaded and encoded while the test file is loaded and encoded on another thread.
+ * 2. Neighbors: the top-k neighbor lists are built in this process or by ShardedBuild worker processes.
+ * 3. Predict and write: test users are predicted on the thread pool and handed to a writer thread through a
+ *    queue, so the output file is written and the RMSE is accumulated while predictions are still running.
+ */
+class Pipeline {
+public:
+	//Constructor.
+    Pipeline(const PipelineConfig& config);
+
+    //Runs the job. Returns the process exit code.
+    int run();
+
+private:
+    PipelineConfig config;
+
+    //Loads a rating file as a store with movie rows (isMovieBased = true) or user rows.
+    CompactStore loadStore(const std::string& fileName, bool isMovieBased) const;
+
+    //Loads a rating file as a DataHash2D.
+    DataHash2D loadDataHash(const std::string& fileName) const;
+
+    //Returns the format of a file, resolving InputFormat::Auto from the extension.
+    InputFormat formatOf(const std::string& fileName) const;
+
+    //Checks the estimated model size against the memory budget, lowering the similarity codec if needed.
+    bool fitMemoryBudget(const CompactStore& rowStore, const CompactStore& columnStore, const CompactStore& testStore);
+
+    /* Builds the neighbor lists of rowStore in this process or with worker processes, or loads them from
+    config.neighborsFile if they were saved for the same store and settings. Returns false on failure. */
+    bool buildNeighbors(const CompactStore& rowStore, CompactNeighbors& neighbors) const;
+
+    //Returns a hash of a store and the neighbor settings, which identifies saved neighbor lists.
+    uint64_t neighborsKey(const CompactStore& rowStore) const;
+
+    //Fits a baseline predictor on the stores of the model and attaches it, unless the baseline is off.
+    void fitBaseline(CompactModel& model) const;
+
+    //Predicts the ratings of a user for a list of movies, in the same order.
+    typedef std::function<void(int, const std::vector<int>&, std::vector<float>&)> UserPredictor;
+
+    /* Predicts the test set with predictUser on the thread pool while a writer thread writes the output file
+    and accumulates the RMSE. */
+    int predictTestSet(const CompactStore& testStore, const UserPredictor& predictUser);
+
+    //Runs Algorithm::HashIBCF or Algorithm::HashUBCF.
+    int runHash();
+
+    //Builds the model of the training data and serves it with a RecommendationServer until SIGINT or SIGTERM.
+    int serve();
+
+    //Runs the load generator against a running server.
+    int runLoadGenerator();
+
+    /* Builds every storage option of the training data, measures the bytes of each structure, and prints
+    them with bytes per rating, neighbor, pair or prediction, projected to config.footprintRatings ratings. */
+    int runFootprint();
+};
+
+#endif // PIPELINE_H
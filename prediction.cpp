@@ -1,13 +1,14 @@
-#include "Prediction.h"
-#include "DataHash2D.h"
-#include "Similarity.h"
-#include "ThreadHandler.h"
+#include "prediction.h"
+#include "dataHash2D.h"
+#include "similarity.h"
+#include "threadHandler.h"
 
 #include <unordered_set>
 #include <unordered_map>
 #include <algorithm>
 #include <stdexcept>
 #include <vector>
+#include <cmath>
 #include <queue>
 #include <mutex>
 
@@ -76,6 +77,11 @@ Prediction::Prediction(const std::string& trainData, const std::string& testData
     this->testData = fileHandler.readFromTXT(testData);
 }
 
+Prediction::Prediction(const DataHash2D& trainData, const DataHash2D& testData) {
+    this->trainData = trainData;
+    this->testData = testData;
+}
+
 std::vector<std::pair<int, float>> Prediction::kNN(RatingMap& similarityMatrix, int Id, int k) {
     if (similarityMatrix.find(Id) == similarityMatrix.end()) throw std::invalid_argument("err: id-not-found-in-similarity-matrix.");
     const auto& similarities = similarityMatrix.at(Id);
@@ -124,10 +130,22 @@ std::vector<std::pair<int, float>> Prediction::kNN(RatingMap& similarityMatrix,
     return kNearestNeighbors;
 }
 
+float Prediction::finalizePrediction(float weightedSum, float similaritySum, int userId, int movieId, bool isMovieBased) const {
+    //Baseline fallback is a single lookup instead of a scan of the training data.
+    return ::finishPrediction(baselineMode, weightedSum, similaritySum, [&]() { return baseline.estimate(userId, movieId); },
+                              [&]() { return trainData.getAverageRating(isMovieBased, isMovieBased ? movieId : userId); });
+}
+
+void Prediction::fitBaseline() {
+    if (baselineMode == BaselineMode::Off || baseline.isFitted()) return;
+    baseline.fit(CompactStore(trainData, true, RatingCodec::Byte), CompactStore(trainData, false, RatingCodec::Byte));
+}
+
 DataHash2D Prediction::calculateIBCF(int k) {
+    fitBaseline();
     DataHash2D predictions;
     Similarity sm;
-    RatingMap similarityMatrix = sm.similarityMatrix(true, trainData);
+    RatingMap similarityMatrix = sm.similarityMatrix(true, trainData, similarityOptions);
     std::vector<int> users = testData.getAllUsers();
 
     ThreadHandler th;
@@ -147,17 +165,13 @@ DataHash2D Prediction::calculateIBCF(int k) {
                     float similarity = neighbor.second;
     
                     float rating = trainData.getRating(neighborMovie, userId);
-                    if (rating >= 0.0f) { 
+                    if (rating >= 0.0f) {
+                        if (baselineMode == BaselineMode::Residual) rating -= baseline.estimate(userId, neighborMovie); 
                         weightedSum += similarity * rating;
                         similaritySum += similarity;
                     }
                 }
-                float predictedRating;
-                if (similaritySum > 0.0f) {
-                    predictedRating = weightedSum / similaritySum;
-                } else {
-                	predictedRating = trainData.getAverageRating(true, currentMovie);
-				}
+                float predictedRating = finalizePrediction(weightedSum, similaritySum, userId, currentMovie, true);
 				predictions.addRating(currentMovie, userId, predictedRating);
             }
         }
@@ -169,9 +183,10 @@ DataHash2D Prediction::calculateIBCF(int k) {
 }
 
 DataHash2D Prediction::calculateUBCF(int k) {
+    fitBaseline();
     DataHash2D predictions;
     Similarity sm;
-    RatingMap similarityMatrix = sm.similarityMatrix(false, trainData);
+    RatingMap similarityMatrix = sm.similarityMatrix(false, trainData, similarityOptions);
     std::vector<int> users = testData.getAllUsers();
 
     ThreadHandler th;
@@ -192,16 +207,12 @@ DataHash2D Prediction::calculateUBCF(int k) {
 
                     float rating = trainData.getRating(currentMovie, neighborUser);
                     if (rating >= 0.0f) {
+                        if (baselineMode == BaselineMode::Residual) rating -= baseline.estimate(neighborUser, currentMovie);
                         weightedSum += similarity * rating;
                         similaritySum += similarity;
                     }
                 }
-                float predictedRating;
-                if (similaritySum > 0.0f) {
-                    predictedRating = weightedSum / similaritySum;
-                } else {
-                	predictedRating = trainData.getAverageRating(false, userId);
-				}
+                float predictedRating = finalizePrediction(weightedSum, similaritySum, userId, currentMovie, false);
 				predictions.addRating(currentMovie, userId, predictedRating);
             }
         }
@@ -213,18 +224,26 @@ DataHash2D Prediction::calculateUBCF(int k) {
     return predictions;
 }
 
-DataHash2D Prediction::runIBCF(int k) {
+DataHash2D Prediction::runIBCF(int k, const std::string& outputFile) {
     DataHash2D predictions = calculateIBCF(k);
-    fileHandler.printToTXT(predictions, "submission.txt");
+    fileHandler.printToTXT(predictions, outputFile);
     return predictions;
 }
 
-DataHash2D Prediction::runUBCF(int k) {
+DataHash2D Prediction::runUBCF(int k, const std::string& outputFile) {
     DataHash2D predictions = calculateUBCF(k);
-    fileHandler.printToTXT(predictions, "submission.txt");
+    fileHandler.printToTXT(predictions, outputFile);
     return predictions;
 }
 
+void Prediction::setBaselineMode(BaselineMode mode) {
+    baselineMode = mode;
+}
+
+void Prediction::setSimilarityOptions(const SimilarityOptions& options) {
+    similarityOptions = options;
+}
+
 float Prediction::RMSE(const DataHash2D& predictedRatings) const {
     float totalErr = 0.0f;
     int n = 0;
@@ -252,6 +271,6 @@ float Prediction::RMSE(const DataHash2D& predictedRatings) const {
         }
     }
     //For preventing division errors.
-    if (n == 0) throw std::cerr < "err: no-predictions-found-to-calculate-RMSE.";
+    if (n == 0) throw std::runtime_error("err: no-predictions-found-to-calculate-RMSE.");
     return std::sqrt(totalErr / n);
 }
@@ -1,8 +1,11 @@
 #ifndef PREDICTION_H
 #define PREDICTION_H
 
-#include "DataHash2D.h"
-#include "FileHandler.h"
+#include "dataHash2D.h"
+#include "fileHandler.h"
+#include "similarity.h"
+#include "baselinePredictor.h"
+#include "compactStore.h"
 
 #include <string>
 
@@ -10,12 +13,21 @@ class Prediction {
 public:
 	//Constructor.
     Prediction(const std::string& trainFile, const std::string& testFile);
+
+    //Constructor. Uses already loaded training and test datasets.
+    Prediction(const DataHash2D& trainData, const DataHash2D& testData);
        
-    //Runs the IBCF method for NBCF.
-    DataHash2D runIBCF(int k);
+    //Runs the IBCF method for NBCF and writes the predictions to outputFile.
+    DataHash2D runIBCF(int k, const std::string& outputFile = "submission.txt");
+    
+    //Runs the UBCF method for NBCF and writes the predictions to outputFile.
+    DataHash2D runUBCF(int k, const std::string& outputFile = "submission.txt");
     
-    //Runs the UBCF method for NBCF.
-    DataHash2D runUBCF(int k);
+    //Sets how the baseline predictor is used by runIBCF and runUBCF. Off by default.
+    void setBaselineMode(BaselineMode mode);
+
+    //Sets the significance weighting used by the similarity matrices of runIBCF and runUBCF.
+    void setSimilarityOptions(const SimilarityOptions& options);
     
 	//Calculates the Root Mean Square Error between given dataset and this->testData.
     float RMSE(const DataHash2D& predictedRatings) const;
@@ -33,6 +45,16 @@ private:
     FileHandler fileHandler; //Instance of fileHandler for file read/write operations.
     DataHash2D trainData;    //Training dataset.
     DataHash2D testData;	 //Test dataset.
+    SimilarityOptions similarityOptions; //Significance weighting of the similarity matrices.
+    BaselineMode baselineMode = BaselineMode::Off; //Use of the baseline predictor, off to keep the original results.
+    BaselinePredictor baseline;          //Baseline predictor fitted on trainData.
+
+    //Fits the baseline predictor on trainData if it is used and not fitted yet.
+    void fitBaseline();
+
+    /* Returns the prediction from the weighted neighbor sums of a user and a movie, or the fallback.
+    isMovieBased selects the average used as fallback without a baseline. */
+    float finalizePrediction(float weightedSum, float similaritySum, int userId, int movieId, bool isMovieBased) const;
 };
 
 #endif // PREDICTION_H
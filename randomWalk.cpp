@@ -0,0 +1,198 @@
+#include "randomWalk.h"
+#include "compactModel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+//splitmix64 step: a small, fast generator that is good enough for sampling hops.
+inline uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//Returns a uniform float in [0, 1).
+inline float nextUniform(uint64_t& state) {
+    return static_cast<float>(nextRandom(state) >> 40) * (1.0f / 16777216.0f);
+}
+
+//Rating codes in 0.02 steps: half-star and 8-bit store ratings are both multiples of it.
+inline uint8_t encodeRating(float rating) {
+    return static_cast<uint8_t>(std::min(std::max(std::round(rating * 50.0f), 0.0f), 250.0f));
+}
+
+inline float decodeRating(uint8_t code) {
+    return code / 50.0f;
+}
+}
+
+struct RandomWalk::WalkState {
+    std::vector<uint32_t> userVisits;    //Visits of every user row.
+    std::vector<uint32_t> movieVisits;   //Visits of every movie row.
+    std::vector<uint32_t> visitedUsers;  //User rows with visits, to clear them.
+    std::vector<uint32_t> visitedMovies; //Movie rows with visits, to clear them.
+    uint64_t totalMovieVisits = 0;
+};
+
+RandomWalk::RandomWalk(const CompactStore& movieStore, const CompactStore& userStore, const RandomWalkOptions& options)
+    : movieStore(movieStore), userStore(userStore), options(options), baselineMode(BaselineMode::Off) {
+    //Larger exponents overflow rating^alpha or its running sums in floats, and sampling would lose its proportions.
+    this->options.alpha = (options.alpha >= 0.0f) ? std::min(options.alpha, 10.0f) : 0.0f;
+    buildAdjacency(userStore, movieStore, userEdges, &userRatingCodes);
+    buildAdjacency(movieStore, userStore, movieEdges, nullptr);
+}
+
+void RandomWalk::buildAdjacency(const CompactStore& store, const CompactStore& other, Adjacency& adjacency,
+                                std::vector<uint8_t>* ratingCodes) const {
+    adjacency.offsets.assign(1, 0);
+    adjacency.targets.reserve(store.getEntryCount());
+    adjacency.cumulative.reserve(store.getEntryCount());
+    if (ratingCodes != nullptr) ratingCodes->reserve(store.getEntryCount());
+    for (size_t row = 0; row < store.getRowCount(); ++row) {
+        float total = 0.0f;
+        CompactStore::Cursor cursor = store.getCursor(row);
+        while (cursor.next()) {
+            long target = other.findRow(cursor.column());
+            if (target < 0) continue;
+            //Ratings below 0.5 walk like 0.5, so every edge can be taken.
+            total += std::pow(std::max(cursor.rating(), 0.5f), options.alpha);
+            adjacency.targets.push_back(static_cast<uint32_t>(target));
+            adjacency.cumulative.push_back(total);
+            if (ratingCodes != nullptr) ratingCodes->push_back(encodeRating(cursor.rating()));
+        }
+        adjacency.offsets.push_back(adjacency.targets.size());
+    }
+}
+
+void RandomWalk::setBaseline(const BaselinePredictor& baseline, BaselineMode mode) {
+    this->baseline = baseline;
+    baselineMode = baseline.isFitted() ? mode : BaselineMode::Off;
+}
+
+uint32_t RandomWalk::sample(const Adjacency& adjacency, size_t node, uint64_t& random) {
+    auto begin = adjacency.cumulative.begin() + adjacency.offsets[node];
+    auto end = adjacency.cumulative.begin() + adjacency.offsets[node + 1];
+    float point = nextUniform(random) * *(end - 1);
+    auto edge = std::upper_bound(begin, end, point);
+    if (edge == end) --edge;
+    return adjacency.targets[edge - adjacency.cumulative.begin()];
+}
+
+RandomWalk::WalkState& RandomWalk::getState() const {
+    thread_local WalkState state; //One per thread, so queries of different threads never share counts.
+    for (uint32_t user : state.visitedUsers) state.userVisits[user] = 0;
+    for (uint32_t movie : state.visitedMovies) state.movieVisits[movie] = 0;
+    state.visitedUsers.clear();
+    state.visitedMovies.clear();
+    state.totalMovieVisits = 0;
+    if (state.userVisits.size() < userStore.getRowCount()) state.userVisits.resize(userStore.getRowCount(), 0);
+    if (state.movieVisits.size() < movieStore.getRowCount()) state.movieVisits.resize(movieStore.getRowCount(), 0);
+    return state;
+}
+
+void RandomWalk::walk(size_t userRow, bool countUsers, size_t target, WalkState& state) const {
+    if (userEdges.offsets[userRow] == userEdges.offsets[userRow + 1]) return;
+    uint64_t random = options.seed ^ (static_cast<uint64_t>(userStore.getRowId(userRow)) * 0xD1B54A32D192ED03ULL);
+    size_t steps = 0;
+    size_t found = 0;
+    while (steps < options.maxSteps && found < target) {
+        uint32_t movie = sample(userEdges, userRow, random);
+        steps++;
+        //One P3 round (movie -> user -> movie) per iteration, then restart or keep walking.
+        do {
+            uint32_t user = sample(movieEdges, movie, random);
+            movie = sample(userEdges, user, random);
+            steps += 2;
+            if (user != userRow) {
+                if (state.userVisits[user]++ == 0) state.visitedUsers.push_back(user);
+                if (countUsers && state.userVisits[user] == options.minVisits) found++;
+            }
+            if (state.movieVisits[movie]++ == 0) state.visitedMovies.push_back(movie);
+            if (!countUsers && state.movieVisits[movie] == options.minVisits) found++;
+            state.totalMovieVisits++;
+        } while (nextUniform(random) >= options.restartProbability && steps < options.maxSteps && found < target);
+    }
+}
+
+void RandomWalk::predictUser(int userId, const std::vector<int>& movieIds, std::vector<float>& predictions) const {
+    predictions.clear();
+    bool residual = (baselineMode == BaselineMode::Residual);
+    long userRow = userStore.findRow(userId);
+    WalkState& state = getState();
+    if (userRow >= 0) walk(userRow, true, options.targetCandidates, state);
+    float userBase = 0.0f; //Baseline of the user without the movie bias.
+    if (baselineMode != BaselineMode::Off) userBase = baseline.getGlobalMean() + (userRow >= 0 ? baseline.getUserBias(userRow) : 0.0f);
+
+    std::vector<long> movieRows(movieIds.size());
+    for (size_t m = 0; m < movieIds.size(); ++m) movieRows[m] = movieStore.findRow(movieIds[m]);
+
+    //Ratings of the movies by the visited users, weighted by their visits. Every visited user is probed with a
+    //binary search in its movie row, so the cost depends on the walk, not on how many users rated the movies.
+    std::vector<float> weightedSums(movieIds.size(), 0.0f);
+    std::vector<float> visitSums(movieIds.size(), 0.0f);
+    //Unknown users are not walked, and the state still holds the previous walk of the thread.
+    size_t visitedCount = (userRow >= 0) ? state.visitedUsers.size() : 0;
+    for (size_t v = 0; v < visitedCount; ++v) {
+        uint32_t user = state.visitedUsers[v];
+        float visits = static_cast<float>(state.userVisits[user]);
+        const uint32_t* begin = userEdges.targets.data() + userEdges.offsets[user];
+        const uint32_t* end = userEdges.targets.data() + userEdges.offsets[user + 1];
+        float neighborBase = residual ? baseline.getGlobalMean() + baseline.getUserBias(user) : 0.0f;
+        for (size_t m = 0; m < movieRows.size(); ++m) {
+            if (movieRows[m] < 0) continue;
+            uint32_t movieRow = static_cast<uint32_t>(movieRows[m]);
+            const uint32_t* edge = std::lower_bound(begin, end, movieRow);
+            if (edge == end || *edge != movieRow) continue;
+            float rating = decodeRating(userRatingCodes[edge - userEdges.targets.data()]);
+            if (residual) rating -= neighborBase + baseline.getMovieBias(movieRow);
+            weightedSums[m] += visits * rating;
+            visitSums[m] += visits;
+        }
+    }
+
+    for (size_t m = 0; m < movieRows.size(); ++m) {
+        long movieRow = movieRows[m];
+        predictions.push_back(finishPrediction(baselineMode, weightedSums[m], visitSums[m],
+                                               [&]() { return userBase + (movieRow >= 0 ? baseline.getMovieBias(movieRow) : 0.0f); },
+                                               [&]() { return movieRow >= 0 ? movieStore.getRowAverage(movieRow) : -1.0f; }));
+    }
+}
+
+void RandomWalk::recommend(int userId, size_t count, std::vector<std::pair<int, float>>& recommendations) const {
+    recommendations.clear();
+    long userRow = userStore.findRow(userId);
+    if (userRow < 0 || count == 0) return;
+    WalkState& state = getState();
+    //Rated movies are visited too, so the walk looks for that many more candidates.
+    size_t degree = userEdges.offsets[userRow + 1] - userEdges.offsets[userRow];
+    walk(userRow, false, count + degree, state);
+    if (state.totalMovieVisits == 0) return;
+
+    //Rated movies of the user are sorted by row, so they are skipped with a merge.
+    const uint32_t* rated = userEdges.targets.data() + userEdges.offsets[userRow];
+    std::vector<uint32_t> visited(state.visitedMovies);
+    std::sort(visited.begin(), visited.end());
+    size_t r = 0;
+    for (uint32_t movie : visited) {
+        while (r < degree && rated[r] < movie) r++;
+        if (r < degree && rated[r] == movie) continue;
+        float share = static_cast<float>(state.movieVisits[movie]) / static_cast<float>(state.totalMovieVisits);
+        recommendations.push_back({ movieStore.getRowId(movie), share });
+    }
+    CompactModel::rankRecommendations(recommendations, count);
+}
+
+MemoryUsage RandomWalk::getMemoryUsage() const {
+    MemoryUsage usage;
+    for (const Adjacency* adjacency : { &userEdges, &movieEdges }) {
+        usage.payloadBytes += adjacency->targets.size() * sizeof(uint32_t);
+        usage.overheadBytes += adjacency->offsets.capacity() * sizeof(uint64_t) + adjacency->cumulative.capacity() * sizeof(float)
+                             + (adjacency->targets.capacity() - adjacency->targets.size()) * sizeof(uint32_t);
+    }
+    usage.payloadBytes += userRatingCodes.size();
+    usage.overheadBytes += userRatingCodes.capacity() - userRatingCodes.size();
+    usage += baseline.getMemoryUsage();
+    return usage;
+}
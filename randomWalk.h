@@ -0,0 +1,91 @@
+#ifndef RANDOMWALK_H
+#define RANDOMWALK_H
+
+#include "compactStore.h"
+#include "baselinePredictor.h"
+#include "memoryTracker.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//Settings of the random walks.
+struct RandomWalkOptions {
+    float alpha = 0.5f;              //Edges are walked with probability proportional to rating^alpha (P3alpha), 0 to 10.
+    float restartProbability = 0.5f; //Chance to jump back to the start user after every user-movie-user-movie round.
+    size_t maxSteps = 20000;         //Step budget of a query, independent of the catalog size.
+    size_t minVisits = 8;            //A candidate counts as found once it is visited this many times.
+    size_t targetCandidates = 64;    //Walks stop early once this many candidates are found.
+    uint64_t seed = 42;              //Walks of a user are reproducible for a seed.
+};
+
+/*
+ * Recommender based on random walks on the bipartite user-movie rating graph.
+ *
+ * The graph is kept in CSR form: the movies of every user and the users of every movie, with the cumulative
+ * edge weights used to sample the next hop, and the ratings of the user edges as 8-bit codes. A query walks from
+ * the user: user -> movie -> user -> movie (the P3 path), then continues with another user -> movie round or
+ * restarts at the user (random walk with restart), and counts how often every user and movie is visited. Walks
+ * stop at the step budget or once enough candidates have been visited minVisits times, so a walk takes at most
+ * maxSteps steps however large the catalog is, and nothing quadratic is precomputed.
+ *
+ * Recommendations rank the unrated movies by their visit share. Rating predictions average the ratings of
+ * the movie by the visited users, weighted by their visit counts, which reaches users several hops away. They are
+ * found with a binary search in the movie row of every visited user, so a prediction probes at most maxSteps / 2
+ * users, however many users rated the movie.
+ * Visit counts live in per-thread arrays, so all methods are const and queries run on any number of threads.
+ */
+class RandomWalk {
+public:
+	//Constructor. Builds the graph from the same ratings as movie rows and user rows.
+    RandomWalk(const CompactStore& movieStore, const CompactStore& userStore, const RandomWalkOptions& options = RandomWalkOptions());
+
+    //Sets the baseline used for fallbacks and residuals. The predictor must be fitted on the same stores.
+    void setBaseline(const BaselinePredictor& baseline, BaselineMode mode);
+
+    //Predicts the ratings of a user for a list of movies, in the same order. -1 where no prediction is possible.
+    void predictUser(int userId, const std::vector<int>& movieIds, std::vector<float>& predictions) const;
+
+    /* Returns up to count (movieId, visit share) pairs of movies the user has not rated, most visited first.
+    Nothing is returned for unknown users. */
+    void recommend(int userId, size_t count, std::vector<std::pair<int, float>>& recommendations) const;
+
+    //Returns the bytes of the graph arrays. The stores are not counted.
+    MemoryUsage getMemoryUsage() const;
+
+private:
+    //Edges of one side of the graph in CSR form. Targets of a node are in ascending row order.
+    struct Adjacency {
+        std::vector<uint64_t> offsets;   //First edge of every node, nodeCount + 1 values.
+        std::vector<uint32_t> targets;   //Node of the other side at the end of every edge.
+        std::vector<float> cumulative;   //Running sum of the edge weights of a node, for sampling.
+    };
+
+    //Per-thread visit counts of a query.
+    struct WalkState;
+
+    CompactStore movieStore; //Copies share the image of the given stores, so they hold no ratings of their own.
+    CompactStore userStore;
+    RandomWalkOptions options;
+    Adjacency userEdges;  //Movies of every user row.
+    Adjacency movieEdges; //Users of every movie row.
+    std::vector<uint8_t> userRatingCodes; //Rating of every user edge, in steps of 0.02 (exact for both rating codecs).
+    BaselinePredictor baseline;
+    BaselineMode baselineMode;
+
+    //Builds the edges of the rows of store, pointing to the rows of other. ratingCodes gets the edge ratings if not null.
+    void buildAdjacency(const CompactStore& store, const CompactStore& other, Adjacency& adjacency,
+                        std::vector<uint8_t>* ratingCodes) const;
+
+    //Samples the next hop from a node. The node must have edges.
+    static uint32_t sample(const Adjacency& adjacency, size_t node, uint64_t& random);
+
+    /* Walks from a user row and fills the visit counts of state. Stops early once target movies
+    (countUsers = false) or users (countUsers = true) reach options.minVisits visits. */
+    void walk(size_t userRow, bool countUsers, size_t target, WalkState& state) const;
+
+    //Returns the visit counts of the calling thread, cleared and sized for this graph.
+    WalkState& getState() const;
+};
+
+#endif // RANDOMWALK_H
@@ -0,0 +1,470 @@
+#include "recommendationServer.h"
+#include "threadHandler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+const uint64_t listenKey = UINT64_MAX;   //epoll key of the listening socket.
+const uint64_t wakeKey = UINT64_MAX - 1; //epoll key of the eventfd.
+const size_t maxLineBytes = 4096;        //Longer request lines close the connection.
+const size_t maxReadBytes = 1 << 16;     //Bytes read from a connection per event, so the backlog limits below take effect.
+const size_t maxOutputBytes = 1 << 20;   //A connection is not read from while more response bytes than this wait to be sent,
+const uint64_t maxInFlight = 4096;       //or while this many of its requests wait for their responses.
+const std::chrono::milliseconds shutdownTimeout(1000); //Time given to clients to receive their last responses.
+
+//Splits a TCP address into host and port. Returns false if address is a Unix socket path.
+bool parseTcpAddress(const std::string& address, std::string& host, std::string& port) {
+    size_t colon = address.rfind(':');
+    port = (colon == std::string::npos) ? address : address.substr(colon + 1);
+    if (port.empty() || port.find_first_not_of("0123456789") != std::string::npos) return false;
+    host = (colon == std::string::npos || colon == 0) ? "127.0.0.1" : address.substr(0, colon);
+    return true;
+}
+
+//Opens a TCP socket bound (isListening, non-blocking) or connected to host:port. Returns -1 on failure.
+int openTcp(const std::string& host, const std::string& port, bool isListening) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo* ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | (isListening ? SOCK_NONBLOCK : 0), ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        bool isOpen;
+        if (isListening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            isOpen = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+        } else {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            isOpen = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (!isOpen) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+//Opens a Unix socket bound (isListening, non-blocking) or connected to path. Returns -1 on failure.
+int openUnix(const std::string& path, bool isListening) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (isListening ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) return -1;
+    bool isOpen;
+    if (isListening) {
+        unlink(path.c_str()); //Left over by a previous server.
+        isOpen = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && listen(fd, SOMAXCONN) == 0;
+    } else {
+        isOpen = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+    if (!isOpen) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//Changes the events of a registered fd.
+void setEvents(int epollFd, int fd, uint64_t key, uint32_t events) {
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = key;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+//Registers an fd.
+bool addEvents(int epollFd, int fd, uint64_t key, uint32_t events) {
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = key;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+}
+
+RecommendationServer::RecommendationServer(const CompactModel& model, size_t numWorkers, size_t batchWindow, size_t maxBatch)
+    : model(model), numWorkers(numWorkers > 0 ? numWorkers : ThreadHandler().getThreadCount()),
+      batchWindow(batchWindow), maxBatch(std::max<size_t>(maxBatch, 1)), epollFd(-1),
+      wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), stopping(false) {}
+
+RecommendationServer::~RecommendationServer() {
+    if (wakeFd >= 0) close(wakeFd);
+}
+
+int RecommendationServer::listenOn(const std::string& address) {
+    std::string host, port;
+    if (parseTcpAddress(address, host, port)) return openTcp(host, port, true);
+    return openUnix(address, true);
+}
+
+int RecommendationServer::connectTo(const std::string& address) {
+    std::string host, port;
+    if (parseTcpAddress(address, host, port)) return openTcp(host, port, false);
+    return openUnix(address, false);
+}
+
+void RecommendationServer::stop() {
+    //Only async-signal-safe work here: run() wakes up, and stops the scheduler under its mutex.
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+bool RecommendationServer::run(const std::string& address) {
+    int listenFd = listenOn(address);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (listenFd < 0 || epollFd < 0 || wakeFd < 0 || !addEvents(epollFd, listenFd, listenKey, EPOLLIN)
+        || !addEvents(epollFd, wakeFd, wakeKey, EPOLLIN)) {
+        std::cerr << "err: could-not-listen-on-''" << address << "''\n";
+        if (listenFd >= 0) close(listenFd);
+        if (epollFd >= 0) close(epollFd);
+        return false;
+    }
+
+    std::thread scheduler(&RecommendationServer::schedulerLoop, this);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers; ++w) workers.emplace_back(&RecommendationServer::workerLoop, this);
+    std::cout << "server-listening-on-" << address << " (" << numWorkers << " workers)" << std::endl;
+
+    uint64_t nextConnectionId = 0;
+    std::vector<epoll_event> events(256);
+    while (!stopping) {
+        int numEvents = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int e = 0; e < numEvents; ++e) {
+            uint64_t key = events[e].data.u64;
+            if (key == listenKey) {
+                int fd;
+                while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //Fails harmlessly on Unix sockets.
+                    uint64_t connectionId = nextConnectionId++;
+                    if (!addEvents(epollFd, fd, connectionId, EPOLLIN)) {
+                        close(fd);
+                        continue;
+                    }
+                    connections[connectionId].fd = fd;
+                    connections[connectionId].events = EPOLLIN;
+                }
+            } else if (key == wakeKey) {
+                deliverResponses();
+            } else if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(key);
+            } else {
+                if (events[e].events & EPOLLIN) readConnection(key);
+                if (events[e].events & EPOLLOUT) flushConnection(key);
+            }
+        }
+    }
+
+    /* Shutdown: nothing new is accepted or read. stopping is set under pendingMutex, so the scheduler cannot miss the
+    notification between its predicate check and its wait. The scheduler schedules the requests still pending, the
+    workers answer every scheduled group, and the responses are sent before the connections are closed. */
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        stopping = true;
+    }
+    pendingReady.notify_all();
+    scheduler.join();
+    groups.close();
+    for (auto& worker : workers) worker.join();
+    deliverResponses();
+    drainConnections(events);
+    close(listenFd);
+    close(epollFd);
+    epollFd = -1;
+    std::string host, port;
+    if (!parseTcpAddress(address, host, port)) unlink(address.c_str());
+    std::cout << "server-stopped." << std::endl;
+    return true;
+}
+
+bool RecommendationServer::parseRequest(const std::string& line, Request& request, std::string& text) const {
+    std::istringstream in(line);
+    std::string command, rest;
+    in >> command;
+    if (command == "predict") {
+        request.type = RequestType::Predict;
+        request.count = 0;
+        if (!(in >> request.userId >> request.movieId) || (in >> rest)) {
+            text = "err: usage-predict-USER-MOVIE";
+            return false;
+        }
+    } else if (command == "recommend") {
+        request.type = RequestType::Recommend;
+        request.movieId = -1;
+        long count;
+        if (!(in >> request.userId >> count) || (in >> rest) || count <= 0) {
+            text = "err: usage-recommend-USER-N";
+            return false;
+        }
+        request.count = static_cast<size_t>(count);
+    } else {
+        text = "err: unknown-command-''" + command + "''";
+        return false;
+    }
+    return true;
+}
+
+void RecommendationServer::readConnection(uint64_t connectionId) {
+    auto ci = connections.find(connectionId); //ci: Connection iterator
+    if (ci == connections.end()) return;
+    Connection& connection = ci->second;
+
+    char buffer[16384];
+    size_t readBytes = 0;
+    while (readBytes < maxReadBytes) {
+        ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            connection.input.append(buffer, static_cast<size_t>(n));
+            readBytes += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == 0) connection.closing = true;
+        else if (errno == EINTR) continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(connectionId);
+            return;
+        }
+        break;
+    }
+
+    std::vector<Request> requests;
+    size_t start = 0, end;
+    while ((end = connection.input.find('\n', start)) != std::string::npos) {
+        std::string line = connection.input.substr(start, end - start);
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        Request request;
+        std::string text;
+        uint64_t sequence = connection.nextSequence++;
+        if (parseRequest(line, request, text)) {
+            request.connectionId = connectionId;
+            request.sequence = sequence;
+            requests.push_back(request);
+        } else {
+            connection.ready[sequence] = text;
+        }
+    }
+    connection.input.erase(0, start);
+    if (connection.input.size() > maxLineBytes) {
+        closeConnection(connectionId);
+        return;
+    }
+
+    if (!requests.empty()) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.insert(pending.end(), requests.begin(), requests.end());
+        pendingReady.notify_one();
+    }
+    flushConnection(connectionId);
+}
+
+void RecommendationServer::flushConnection(uint64_t connectionId) {
+    auto ci = connections.find(connectionId); //ci: Connection iterator
+    if (ci == connections.end()) return;
+    Connection& connection = ci->second;
+
+    //Responses are sent in request order, a response waits in ready until all earlier ones are out.
+    for (auto ri = connection.ready.begin(); ri != connection.ready.end() && ri->first == connection.nextToWrite;
+         ri = connection.ready.erase(ri)) {
+        connection.output += ri->second;
+        connection.output += '\n';
+        connection.nextToWrite++;
+    }
+
+    size_t sent = 0;
+    while (sent < connection.output.size()) {
+        ssize_t n = send(connection.fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) sent += static_cast<size_t>(n);
+        else if (n < 0 && errno == EINTR) continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        else {
+            closeConnection(connectionId);
+            return;
+        }
+    }
+    connection.output.erase(0, sent);
+
+    if (connection.closing && connection.output.empty() && connection.nextToWrite == connection.nextSequence) {
+        closeConnection(connectionId);
+        return;
+    }
+    //Clients that pipeline requests without reading their responses are not read from until their backlog drains.
+    bool isReading = !connection.closing && connection.output.size() < maxOutputBytes
+                     && connection.nextSequence - connection.nextToWrite < maxInFlight;
+    uint32_t events = (isReading ? static_cast<uint32_t>(EPOLLIN) : 0u)
+                    | (connection.output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    if (events != connection.events) {
+        setEvents(epollFd, connection.fd, connectionId, events);
+        connection.events = events;
+    }
+}
+
+void RecommendationServer::deliverResponses() {
+    uint64_t count;
+    while (read(wakeFd, &count, sizeof(count)) > 0) {}
+    std::vector<Response> delivered;
+    {
+        std::lock_guard<std::mutex> lock(responseMutex);
+        delivered.swap(responses);
+    }
+    std::vector<uint64_t> touched;
+    for (auto& response : delivered) {
+        auto ci = connections.find(response.connectionId); //ci: Connection iterator
+        if (ci == connections.end()) continue; //The client is gone.
+        ci->second.ready[response.sequence] = std::move(response.text);
+        touched.push_back(response.connectionId);
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (uint64_t connectionId : touched) flushConnection(connectionId);
+}
+
+void RecommendationServer::drainConnections(std::vector<epoll_event>& events) {
+    std::vector<uint64_t> open;
+    for (auto& connection : connections) {
+        connection.second.closing = true;
+        open.push_back(connection.first);
+    }
+    for (uint64_t connectionId : open) flushConnection(connectionId); //Closes the connections with nothing left to send.
+
+    auto deadline = std::chrono::steady_clock::now() + shutdownTimeout;
+    while (!connections.empty()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) break;
+        int numEvents = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), static_cast<int>(left.count()));
+        if (numEvents < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int e = 0; e < numEvents; ++e) {
+            uint64_t key = events[e].data.u64;
+            if (key == wakeKey) deliverResponses();
+            else if (events[e].events & (EPOLLERR | EPOLLHUP)) closeConnection(key);
+            else if (events[e].events & EPOLLOUT) flushConnection(key);
+        }
+    }
+    while (!connections.empty()) closeConnection(connections.begin()->first);
+}
+
+void RecommendationServer::closeConnection(uint64_t connectionId) {
+    auto ci = connections.find(connectionId); //ci: Connection iterator
+    if (ci == connections.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, ci->second.fd, nullptr);
+    close(ci->second.fd);
+    connections.erase(ci);
+}
+
+void RecommendationServer::schedulerLoop() {
+    std::vector<Request> batch;
+    std::vector<RequestGroup> batchGroups;
+    std::unordered_map<uint64_t, size_t> groupIndex; //Group key to position in batchGroups.
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            pendingReady.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty()) return; //Stopping, and every request is scheduled.
+            //Waits for more requests to coalesce with, unless the batch is already full or the server is stopping.
+            if (!stopping) {
+                auto deadline = std::chrono::steady_clock::now() + batchWindow;
+                pendingReady.wait_until(lock, deadline, [this]() { return stopping || pending.size() >= maxBatch; });
+            }
+            batch.swap(pending);
+        }
+
+        //IBCF shares the ratings of a user, UBCF the ratings of a movie. Recommendations always share the user.
+        for (const Request& request : batch) {
+            bool byUser = (request.type == RequestType::Recommend) || model.isMovieBased();
+            int key = byUser ? request.userId : request.movieId;
+            uint64_t groupKey = (static_cast<uint64_t>(request.type == RequestType::Recommend) << 32) | static_cast<uint32_t>(key);
+            auto gi = groupIndex.find(groupKey); //gi: Group iterator
+            if (gi == groupIndex.end()) {
+                gi = groupIndex.emplace(groupKey, batchGroups.size()).first;
+                batchGroups.push_back({ request.type, byUser, key, std::vector<Request>() });
+            }
+            batchGroups[gi->second].requests.push_back(request);
+        }
+        for (auto& group : batchGroups) groups.push(std::move(group));
+        batch.clear();
+        batchGroups.clear();
+        groupIndex.clear();
+    }
+}
+
+void RecommendationServer::workerLoop() {
+    RequestGroup group;
+    std::vector<Response> answers;
+    while (groups.pop(group)) {
+        answers.clear();
+        answer(group, answers);
+        {
+            std::lock_guard<std::mutex> lock(responseMutex);
+            for (auto& response : answers) responses.push_back(std::move(response));
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void RecommendationServer::answer(const RequestGroup& group, std::vector<Response>& answers) const {
+    if (group.type == RequestType::Predict) {
+        std::vector<int> ids;
+        std::vector<float> predictions;
+        for (const Request& request : group.requests) ids.push_back(group.byUser ? request.movieId : request.userId);
+        if (group.byUser) model.predictUser(group.key, ids, predictions);
+        else model.predictMovie(group.key, ids, predictions);
+        for (size_t r = 0; r < group.requests.size(); ++r) {
+            const Request& request = group.requests[r];
+            std::ostringstream text;
+            text << request.userId << " " << request.movieId << " " << predictions[r];
+            answers.push_back({ request.connectionId, request.sequence, text.str() });
+        }
+    } else {
+        //One ranking serves every request of the user, each gets its own prefix.
+        size_t count = 0;
+        for (const Request& request : group.requests) count = std::max(count, request.count);
+        std::vector<std::pair<int, float>> recommendations;
+        model.recommend(group.key, count, recommendations);
+        for (const Request& request : group.requests) {
+            std::ostringstream text;
+            text << request.userId;
+            for (size_t m = 0; m < std::min(request.count, recommendations.size()); ++m) {
+                text << " " << recommendations[m].first << ":" << recommendations[m].second;
+            }
+            answers.push_back({ request.connectionId, request.sequence, text.str() });
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef RECOMMENDATIONSERVER_H
+#define RECOMMENDATIONSERVER_H
+
+#include "compactModel.h"
+#include "blockingQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+
+/*
+ * Line protocol server answering predictions and recommendations from an immutable CompactModel.
+ *
+ * Requests, one per line:
+ *   predict USER MOVIE    -> "USER MOVIE RATING", RATING is -1 if no prediction is possible.
+ *   recommend USER N      -> "USER MOVIE:RATING MOVIE:RATING ..." with up to N unrated movies, best first.
+ * Malformed requests are answered with an "err: ..." line. Responses of a connection come back in request order,
+ * so clients can pipeline requests.
+ *
+ * One I/O thread runs an epoll loop over the listening socket and all connections. Parsed requests go to the
+ * scheduler thread, which waits up to batchWindow for more requests and coalesces them into groups that share
+ * the work: predictions by user for IBCF (one decode of the user ratings) or by movie for UBCF (one decode of
+ * the movie ratings), and recommendations by user. Groups are handed to the worker threads through a queue, and
+ * the workers pass the responses back to the I/O thread, which is woken up through an eventfd.
+ * A connection is not read from while too many of its responses wait to be sent, so a client that pipelines without
+ * reading cannot make the server buffer without limit. On stop() the requests already read are still answered.
+ */
+class RecommendationServer {
+public:
+	//Constructor. numWorkers = 0: Uses the default thread count. batchWindow in microseconds.
+    RecommendationServer(const CompactModel& model, size_t numWorkers = 0, size_t batchWindow = 200, size_t maxBatch = 1024);
+
+    //Destructor.
+    ~RecommendationServer();
+
+    /* Serves address until stop() is called. Returns false if the address could not be opened.
+    address is "PORT" or "HOST:PORT" for TCP (host defaults to 127.0.0.1), anything else is a Unix socket path. */
+    bool run(const std::string& address);
+
+    //Makes run() return once the requests already read are answered and sent. Safe to call from a signal handler.
+    void stop();
+
+    //Connects to an address in the format of run(). Returns the socket, -1 on failure.
+    static int connectTo(const std::string& address);
+
+private:
+    //Kind of a request.
+    enum class RequestType { Predict, Recommend };
+
+    //One parsed request line.
+    struct Request {
+        RequestType type;
+        int userId;
+        int movieId;   //Predict only.
+        size_t count;  //Recommend only.
+        uint64_t connectionId;
+        uint64_t sequence; //Position of the request on its connection.
+    };
+
+    //Requests that share their work, answered together by one worker.
+    struct RequestGroup {
+        RequestType type;
+        bool byUser;   //Key is a user id, else a movie id.
+        int key;
+        std::vector<Request> requests;
+    };
+
+    //Response to a request, routed back to its connection.
+    struct Response {
+        uint64_t connectionId;
+        uint64_t sequence;
+        std::string text;
+    };
+
+    //State of a client connection, owned by the I/O thread.
+    struct Connection {
+        int fd;
+        std::string input;   //Received bytes without a full line yet.
+        std::string output;  //Response bytes not yet sent.
+        uint64_t nextSequence = 0; //Sequence of the next request.
+        uint64_t nextToWrite = 0;  //Sequence of the next response to send.
+        std::map<uint64_t, std::string> ready; //Responses waiting for earlier ones.
+        bool closing = false;  //No more requests are read (the client closed its side or the server stops), close once all responses are sent.
+        uint32_t events = 0;   //Registered epoll events.
+    };
+
+    const CompactModel& model;
+    size_t numWorkers;
+    std::chrono::microseconds batchWindow;
+    size_t maxBatch;
+
+    int epollFd;
+    int wakeFd; //eventfd signalled by workers and stop().
+    std::atomic<bool> stopping;
+
+    std::mutex pendingMutex;             //Guards pending.
+    std::condition_variable pendingReady;
+    std::vector<Request> pending;        //Requests waiting for the scheduler.
+    BlockingQueue<RequestGroup> groups;  //Groups waiting for a worker.
+
+    std::mutex responseMutex;            //Guards responses.
+    std::vector<Response> responses;     //Responses waiting for the I/O thread.
+
+    std::unordered_map<uint64_t, Connection> connections;
+
+    //Opens the listening socket. Returns -1 on failure.
+    static int listenOn(const std::string& address);
+
+    //Scheduler thread body: batches pending requests into groups.
+    void schedulerLoop();
+
+    //Worker thread body: answers request groups.
+    void workerLoop();
+
+    //Answers a group of requests.
+    void answer(const RequestGroup& group, std::vector<Response>& answers) const;
+
+    //Parses a request line. Returns false with an error response in text for malformed lines.
+    bool parseRequest(const std::string& line, Request& request, std::string& text) const;
+
+    //Reads from a connection and submits the complete request lines.
+    void readConnection(uint64_t connectionId);
+
+    //Moves the ready responses of a connection to its output and sends as much as possible.
+    void flushConnection(uint64_t connectionId);
+
+    //Moves the responses of the workers to their connections and flushes them.
+    void deliverResponses();
+
+    //Sends the responses left at shutdown, for at most a second, then closes every connection.
+    void drainConnections(std::vector<epoll_event>& events);
+
+    //Closes and forgets a connection.
+    void closeConnection(uint64_t connectionId);
+};
+
+#endif // RECOMMENDATIONSERVER_H
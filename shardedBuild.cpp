@@ -0,0 +1,266 @@
+#include "shardedBuild.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Wire format, all integers in host byte order:
+ * - Task:   uint64 rowStart, uint64 rowEnd.
+ * - Result: uint64 rowStart, uint64 rowEnd, uint64 payloadBytes, then for every row from rowStart to the last row
+ *           uint32 count followed by count (uint32 neighborRow, float similarity) pairs: the partial top-k lists
+ *           of Similarity::blockNeighbors.
+ * The coordinator stops a worker by closing its socket.
+ */
+namespace {
+bool sendAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+template <typename T>
+void appendValue(std::vector<char>& buffer, T value) {
+    const char* p = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T readValue(const char*& p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+//Writes the partial neighbor lists of a block into the result payload.
+std::vector<char> encodeBlock(const std::vector<std::vector<std::pair<uint32_t, float>>>& block) {
+    std::vector<char> payload;
+    for (const auto& row : block) {
+        appendValue<uint32_t>(payload, static_cast<uint32_t>(row.size()));
+        for (const auto& neighbor : row) {
+            appendValue<uint32_t>(payload, neighbor.first);
+            appendValue<float>(payload, neighbor.second);
+        }
+    }
+    return payload;
+}
+
+/* Reads the result payload of a block, the partial lists of the rows rowStart to numRows - 1. Returns false if the
+payload does not hold exactly these rows with at most capacity valid neighbors each. */
+bool decodeBlock(const std::vector<char>& payload, size_t rowStart, size_t numRows, size_t capacity,
+                 std::vector<std::vector<std::pair<uint32_t, float>>>& block) {
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    block.assign(numRows - rowStart, {});
+    for (auto& row : block) {
+        if (end - p < static_cast<long>(sizeof(uint32_t))) return false;
+        uint32_t count = readValue<uint32_t>(p);
+        if (count > capacity || static_cast<size_t>(end - p) < count * (sizeof(uint32_t) + sizeof(float))) return false;
+        for (uint32_t n = 0; n < count; ++n) {
+            uint32_t neighborRow = readValue<uint32_t>(p);
+            float similarity = readValue<float>(p);
+            if (neighborRow >= numRows) return false;
+            row.emplace_back(neighborRow, similarity);
+        }
+    }
+    return p == end;
+}
+
+//Returns the row blocks of about the same number of pairs (i, j > i), so the early rows get smaller blocks.
+std::deque<std::pair<size_t, size_t>> balancedBlocks(size_t numRows, size_t numBlocks) {
+    std::deque<std::pair<size_t, size_t>> blocks;
+    uint64_t totalPairs = static_cast<uint64_t>(numRows) * (numRows - 1) / 2;
+    uint64_t pairs = 0;
+    size_t start = 0;
+    for (size_t row = 0; row < numRows; ++row) {
+        pairs += numRows - 1 - row;
+        if (row + 1 == numRows || pairs * numBlocks >= totalPairs * (blocks.size() + 1)) {
+            blocks.emplace_back(start, row + 1);
+            start = row + 1;
+        }
+    }
+    return blocks;
+}
+}
+
+ShardedBuild::ShardedBuild(size_t numWorkers, size_t blockRows) {
+    this->numWorkers = std::max<size_t>(numWorkers, 1);
+    this->blockRows = blockRows;
+}
+
+void ShardedBuild::workerLoop(int fd, const std::string& snapshotFile, int k, const SimilarityOptions& options) {
+    CompactStore store = CompactStore::loadSnapshot(snapshotFile);
+    Similarity sm;
+    uint64_t task[2]; //(rowStart, rowEnd)
+
+    while (receiveAll(fd, task, sizeof(task))) {
+        std::vector<char> payload = encodeBlock(sm.blockNeighbors(store, task[0], task[1], k, 0, options));
+        uint64_t header[3] = { task[0], task[1], payload.size() };
+        if (!sendAll(fd, header, sizeof(header)) || !sendAll(fd, payload.data(), payload.size())) break;
+    }
+}
+
+bool ShardedBuild::run(const std::string& snapshotFile, int k, CompactNeighbors& neighbors, SimilarityCodec codec,
+                       const SimilarityOptions& options) {
+    CompactStore store = CompactStore::loadSnapshot(snapshotFile);
+    size_t numRows = store.getRowCount();
+    size_t capacity = CompactNeighbors::capacityFor(numRows, k);
+    neighbors = CompactNeighbors(numRows, capacity, codec);
+    if (numRows == 0) return true;
+
+    std::deque<std::pair<size_t, size_t>> pending; //(rowStart, rowEnd)
+    if (blockRows > 0) {
+        for (size_t start = 0; start < numRows; start += blockRows) pending.emplace_back(start, std::min(start + blockRows, numRows));
+    } else {
+        pending = balancedBlocks(numRows, numWorkers * 4);
+    }
+
+    //Partial lists of every block are merged into per-row top-k heaps once the whole block is received.
+    std::vector<std::vector<NeighborCandidate>> heaps(numRows);
+    auto mergeBlock = [&](size_t rowStart, const std::vector<std::vector<std::pair<uint32_t, float>>>& block) {
+        for (size_t r = 0; r < block.size(); ++r) {
+            for (const auto& n : block[r]) CompactNeighbors::pushCandidate(heaps[rowStart + r], capacity, NeighborCandidate(n.second, n.first));
+        }
+    };
+
+    //Start the workers. Buffered output is flushed so it is not duplicated in the children.
+    std::cout.flush();
+    std::fflush(stdout);
+    std::vector<int> fds;
+    std::vector<pid_t> pids;
+    for (size_t w = 0; w < numWorkers; ++w) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            std::cerr << "err: could-not-create-worker-socket.\n";
+            break;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "err: could-not-fork-worker-process.\n";
+            close(sv[0]);
+            close(sv[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(sv[0]);
+            for (int fd : fds) close(fd); //Sockets of the other workers.
+            workerLoop(sv[1], snapshotFile, k, options);
+            close(sv[1]);
+            _exit(0);
+        }
+        close(sv[1]);
+        fds.push_back(sv[0]);
+        pids.push_back(pid);
+    }
+
+    //Task currently assigned to every worker, (0, 0) when idle.
+    std::vector<std::pair<size_t, size_t>> assigned(fds.size(), std::make_pair<size_t, size_t>(0, 0));
+    std::vector<bool> alive(fds.size(), true);
+    size_t busy = 0;
+
+    auto dropWorker = [&](size_t w) {
+        std::cerr << "err: worker-" << w << "-failed-its-block-is-rescheduled.\n";
+        if (assigned[w].second > assigned[w].first) {
+            pending.push_front(assigned[w]);
+            busy--;
+        }
+        assigned[w] = std::make_pair<size_t, size_t>(0, 0);
+        alive[w] = false;
+        close(fds[w]);
+    };
+    auto assignTasks = [&]() {
+        for (size_t w = 0; w < fds.size() && !pending.empty(); ++w) {
+            if (!alive[w] || assigned[w].second > assigned[w].first) continue;
+            uint64_t task[2] = { pending.front().first, pending.front().second };
+            assigned[w] = pending.front();
+            pending.pop_front();
+            busy++;
+            if (!sendAll(fds[w], task, sizeof(task))) dropWorker(w);
+        }
+    };
+
+    bool failed = false;
+    assignTasks();
+    while (busy > 0 && !failed) {
+        std::vector<pollfd> pollFds;
+        std::vector<size_t> pollWorkers;
+        for (size_t w = 0; w < fds.size(); ++w) {
+            if (alive[w] && assigned[w].second > assigned[w].first) {
+                pollFds.push_back({ fds[w], POLLIN, 0 });
+                pollWorkers.push_back(w);
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "err: could-not-poll-worker-sockets-" << std::strerror(errno) << ".\n";
+            failed = true;
+            break;
+        }
+
+        for (size_t p = 0; p < pollFds.size(); ++p) {
+            if (pollFds[p].revents == 0) continue;
+            size_t w = pollWorkers[p];
+            uint64_t header[3]; //(rowStart, rowEnd, payloadBytes)
+            std::vector<char> payload;
+            std::vector<std::vector<std::pair<uint32_t, float>>> block;
+            bool ok = receiveAll(fds[w], header, sizeof(header))
+                      && header[0] == assigned[w].first && header[1] == assigned[w].second;
+            //The size comes from the worker, so it is bounded by the largest valid result before anything is allocated.
+            size_t maxPayload = (numRows - assigned[w].first) * (sizeof(uint32_t) + capacity * (sizeof(uint32_t) + sizeof(float)));
+            ok = ok && header[2] <= maxPayload;
+            if (ok) {
+                payload.resize(header[2]);
+                ok = receiveAll(fds[w], payload.data(), payload.size())
+                     && decodeBlock(payload, header[0], numRows, capacity, block);
+            }
+            if (!ok) {
+                dropWorker(w);
+                continue;
+            }
+            mergeBlock(header[0], block);
+            assigned[w] = std::make_pair<size_t, size_t>(0, 0);
+            busy--;
+        }
+        assignTasks();
+    }
+
+    //Blocks left over when every worker failed are computed here.
+    Similarity sm;
+    for (const auto& block : pending) {
+        if (failed) break;
+        mergeBlock(block.first, sm.blockNeighbors(store, block.first, block.second, k, 0, options));
+    }
+
+    //Closing the sockets stops the workers.
+    for (size_t w = 0; w < fds.size(); ++w) if (alive[w]) close(fds[w]);
+    for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+    if (failed) return false;
+    neighbors = CompactNeighbors::fromCandidates(heaps, capacity, codec);
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef SHARDEDBUILD_H
+#define SHARDEDBUILD_H
+
+#include "compactStore.h"
+#include "compactNeighbors.h"
+#include "similarity.h"
+
+#include <string>
+
+/*
+ * Multi-process build of the neighbor lists of a CompactStore snapshot.
+ *
+ * The coordinator splits the rows into blocks and forks numWorkers worker processes connected to it with Unix sockets.
+ * Every worker maps the same snapshot file and receives row-block tasks. It scores each pair of a block row with a later
+ * row once, as the in-process build does, and sends back the partial top-k lists of both rows of the pairs. Blocks are
+ * handed out as workers become free, and the partial lists are merged into one CompactNeighbors.
+ * Tasks and results are plain byte messages over a stream socket, so the same protocol can reach workers on other nodes.
+ * If a worker dies its block is given to another worker; if none are left the coordinator computes the rest itself.
+ */
+class ShardedBuild {
+public:
+	//Constructor. blockRows = 0: Rows are split into 4 blocks per worker with about the same number of pairs.
+    ShardedBuild(size_t numWorkers = 2, size_t blockRows = 0);
+
+    /* Builds the top-k neighbor lists of the store saved at snapshotFile with the worker processes.
+    Returns false if the workers could not be polled. Workers are forked without exec, so the calling process must
+    not run other threads (thread pools, loaders, servers) during the call: a child would inherit their locks held. */
+    bool run(const std::string& snapshotFile, int k, CompactNeighbors& neighbors, SimilarityCodec codec = SimilarityCodec::Short,
+             const SimilarityOptions& options = SimilarityOptions());
+
+private:
+    size_t numWorkers; //Number of worker processes.
+    size_t blockRows;  //Number of rows per task.
+
+    //Worker process body: answers row-block tasks read from fd until the coordinator closes it.
+    void workerLoop(int fd, const std::string& snapshotFile, int k, const SimilarityOptions& options);
+};
+
+#endif // SHARDEDBUILD_H
@@ -1,28 +1,42 @@
-#include "Similarity.h"
-#include "ThreadHandler.h"
+#include "similarity.h"
+#include "threadHandler.h"
 
 #include <unordered_map>
 #include <thread>
 #include <mutex>
 #include <cmath>
+#include <queue>
+#include <tuple>
+#include <algorithm>
+#include <memory>
+#include <unistd.h>
 
 float Similarity::cosineSimilarity(const std::unordered_map<int, float>& vec1, 
                                    const std::unordered_map<int, float>& vec2) {
+    return cosineScore(vec1, vec2).similarity;
+}
+
+SimilarityScore Similarity::cosineScore(const std::unordered_map<int, float>& vec1,
+                                        const std::unordered_map<int, float>& vec2) {
     float dotProduct = 0.0f, magnitude1 = 0.0f, magnitude2 = 0.0f;
+    size_t overlap = 0;
 
     for (const auto& item1 : vec1) {
         float value1 = item1.second;
         magnitude1 += value1 * value1;
 
         auto i = vec2.find(item1.first); //i: Iterator
-        if (i != vec2.end()) dotProduct += value1 * i->second;
+        if (i != vec2.end()) {
+            dotProduct += value1 * i->second;
+            overlap++;
+        }
     }
 
     for (const auto& item2 : vec2) magnitude2 += item2.second * item2.second;
 
     //For preventing division errors.
-    if (magnitude1 == 0.0f || magnitude2 == 0.0f) return 0.0f;
-    return dotProduct / (std::sqrt(magnitude1) * std::sqrt(magnitude2));
+    if (magnitude1 == 0.0f || magnitude2 == 0.0f) return { 0.0f, overlap };
+    return { dotProduct / (std::sqrt(magnitude1) * std::sqrt(magnitude2)), overlap };
 }
 
 float Similarity::adjustedCosineSimilarity(const std::unordered_map<int, float>& vec1, 
@@ -40,6 +54,11 @@ float Similarity::jaccardSimilarity(const std::unordered_map<int, float>& vec1 ,
 }
 
 RatingMap Similarity::similarityMatrix(bool isMovieBased, const DataHash2D& dh) {
+    return similarityMatrix(isMovieBased, dh, SimilarityOptions());
+}
+
+RatingMap Similarity::similarityMatrix(bool isMovieBased, const DataHash2D& dh, const SimilarityOptions& options) {
+    if (options.metric != SimilarityMetric::Cosine) std::cerr << "err: only-cosine-is-available-on-DataHash2D-using-cosine.\n";
     std::unordered_map<int, std::unordered_map<int, float>> matrix;
 	//Running DataHash2D::getAllMovies() or DataHash2D::getAllUsers() based on bool isMovieBased.
     std::vector<int> entities = isMovieBased ? dh.getAllMovies() : dh.getAllUsers();
@@ -55,10 +74,17 @@ RatingMap Similarity::similarityMatrix(bool isMovieBased, const DataHash2D& dh)
             int entity1 = entities[i];
             std::unordered_map<int, float> ratings1 = (dh.*getRatings)(entity1);
 
+            //Every entity keeps a row, even if all of its pairs are cut off.
+            th.lock();
+            matrix[entity1];
+            th.unlock();
+
             for (size_t j = i + 1; j < numEntities; ++j) {
                 int entity2 = entities[j];
                 std::unordered_map<int, float> ratings2 = (dh.*getRatings)(entity2);
-                float similarity = cosineSimilarity(ratings1, ratings2);
+                SimilarityScore score = cosineScore(ratings1, ratings2);
+                if (score.overlap < options.minOverlap) continue; //Pairs below the cutoff are not stored.
+                float similarity = weight(score, options);
 
                 th.lock();
                 matrix[entity1][entity2] = similarity; //Upper triangular.
@@ -76,6 +102,192 @@ RatingMap Similarity::similarityMatrix(bool isMovieBased, const DataHash2D& dh)
     //TODO: Modify the method so that different similarity metrics can be selected using a parameter.
 }
 
+float Similarity::cosineSimilarity(const CompactStore& store, size_t row1, size_t row2) {
+    return score(store, row1, row2, SimilarityMetric::Cosine).similarity;
+}
+
+float Similarity::weight(const SimilarityScore& score, const SimilarityOptions& options) {
+    if (score.overlap < options.minOverlap) return 0.0f;
+    if (options.shrinkage <= 0.0f) return score.similarity;
+    float n = static_cast<float>(score.overlap);
+    return score.similarity * n / (n + options.shrinkage);
+}
+
+float Similarity::similarity(const CompactStore& store, size_t row1, size_t row2, const SimilarityOptions& options) {
+    return weight(score(store, row1, row2, options.metric), options);
+}
+
+SimilarityScore Similarity::score(const CompactStore& store, size_t row1, size_t row2, SimilarityMetric metric) {
+    float magnitude1 = store.getRowNorm(row1), magnitude2 = store.getRowNorm(row2);
+
+    //Both rows are sorted by column id, so every metric is a single merge over the co-rated columns.
+    CompactStore::Cursor c1 = store.getCursor(row1), c2 = store.getCursor(row2);
+    float dotProduct = 0.0f, sum1 = 0.0f, sum2 = 0.0f, squareSum1 = 0.0f, squareSum2 = 0.0f;
+    size_t overlap = 0;
+    bool has1 = c1.next(), has2 = c2.next();
+    while (has1 && has2) {
+        if (c1.column() < c2.column()) has1 = c1.next();
+        else if (c2.column() < c1.column()) has2 = c2.next();
+        else {
+            float value1 = c1.rating(), value2 = c2.rating();
+            dotProduct += value1 * value2;
+            sum1 += value1;
+            sum2 += value2;
+            squareSum1 += value1 * value1;
+            squareSum2 += value2 * value2;
+            overlap++;
+            has1 = c1.next();
+            has2 = c2.next();
+        }
+    }
+
+    //The co-rated count comes out of the same merge, so significance weighting needs no extra pass.
+    switch (metric) {
+    case SimilarityMetric::Pearson: {
+        if (overlap == 0) return { 0.0f, overlap };
+        float n = static_cast<float>(overlap);
+        float covariance = dotProduct - sum1 * sum2 / n;
+        float variance1 = squareSum1 - sum1 * sum1 / n;
+        float variance2 = squareSum2 - sum2 * sum2 / n;
+        if (variance1 <= 0.0f || variance2 <= 0.0f) return { 0.0f, overlap };
+        return { covariance / (std::sqrt(variance1) * std::sqrt(variance2)), overlap };
+    }
+    case SimilarityMetric::Jaccard: {
+        size_t unionSize = store.getRowLength(row1) + store.getRowLength(row2) - overlap;
+        return { unionSize == 0 ? 0.0f : static_cast<float>(overlap) / unionSize, overlap };
+    }
+    default:
+        //For preventing division errors.
+        if (magnitude1 == 0.0f || magnitude2 == 0.0f) return { 0.0f, overlap };
+        return { dotProduct / (magnitude1 * magnitude2), overlap };
+    }
+}
+
+CompactNeighbors Similarity::neighborLists(const CompactStore& store, int k, SimilarityCodec codec, const SimilarityOptions& options) {
+    size_t numRows = store.getRowCount();
+    size_t capacity = CompactNeighbors::capacityFor(numRows, k);
+
+    //Per-row top-k min-heaps of (similarity, row). Both rows of a pair are filled, so every heap has its own mutex.
+    std::vector<std::vector<NeighborCandidate>> heaps(numRows);
+    std::unique_ptr<std::mutex[]> rowMutexes(new std::mutex[numRows]);
+
+    //Every pair is scored once, by its lower row (j > i). Rows get fewer pairs as i grows, so rows are pulled as tasks.
+    auto calculateRow = [&](size_t i) {
+        std::vector<NeighborCandidate> rowHeap; //Candidates of row i from this task, merged into heaps[i] at the end.
+        for (size_t j = i + 1; j < numRows; ++j) {
+            float similarity = this->similarity(store, i, j, options);
+            if (similarity <= 0.0f) continue;
+            CompactNeighbors::pushCandidate(rowHeap, capacity, NeighborCandidate(similarity, static_cast<uint32_t>(j)));
+            std::lock_guard<std::mutex> lock(rowMutexes[j]);
+            CompactNeighbors::pushCandidate(heaps[j], capacity, NeighborCandidate(similarity, static_cast<uint32_t>(i)));
+        }
+        std::lock_guard<std::mutex> lock(rowMutexes[i]);
+        for (const NeighborCandidate& c : rowHeap) CompactNeighbors::pushCandidate(heaps[i], capacity, c);
+    };
+    ThreadHandler th;
+    th.runTasks(calculateRow, numRows);
+    return CompactNeighbors::fromCandidates(heaps, capacity, codec);
+}
+
+size_t Similarity::tileRowCount(const CompactStore& store) {
+    long l2Size = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2Size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (l2Size <= 0) l2Size = 256 * 1024; //Assume a 256 KiB L2 if the system does not report it.
+
+    size_t numRows = store.getRowCount();
+    if (numRows == 0) return 1;
+    size_t bytesPerRow = std::max<size_t>(store.getByteSize() / numRows, 1);
+    return std::max<size_t>(static_cast<size_t>(l2Size) / (2 * bytesPerRow), 1);
+}
+
+CompactNeighbors Similarity::tiledNeighborLists(const CompactStore& store, int k, SimilarityCodec codec, size_t tileRows,
+                                                const SimilarityOptions& options) {
+    size_t numRows = store.getRowCount();
+    size_t capacity = CompactNeighbors::capacityFor(numRows, k);
+    if (tileRows == 0) tileRows = tileRowCount(store);
+    size_t numBlocks = (numRows + tileRows - 1) / tileRows;
+
+    //Per-row top-k min-heaps of (similarity, row), guarded by one mutex per row block.
+    std::vector<std::vector<NeighborCandidate>> heaps(numRows);
+    std::unique_ptr<std::mutex[]> blockMutexes(new std::mutex[numBlocks]);
+    auto pushCandidate = [&](uint32_t row, float similarity, uint32_t other) {
+        CompactNeighbors::pushCandidate(heaps[row], capacity, NeighborCandidate(similarity, other));
+    };
+
+    //Accumulator entries per tile: 12 KiB, well below L1, whatever the tile size is.
+    const size_t accumulatorEntries = 1024;
+
+    //Tasks are the block pairs (I, J) with I <= J, enumerated row by row of the block triangle.
+    std::vector<std::pair<size_t, size_t>> tiles;
+    for (size_t bi = 0; bi < numBlocks; ++bi) {
+        for (size_t bj = bi; bj < numBlocks; ++bj) tiles.emplace_back(bi, bj);
+    }
+
+    ThreadHandler th;
+    auto processTile = [&](size_t t) {
+        size_t bi = tiles[t].first, bj = tiles[t].second;
+        size_t iStart = bi * tileRows, iEnd = std::min(iStart + tileRows, numRows);
+        size_t jStart = bj * tileRows, jEnd = std::min(jStart + tileRows, numRows);
+
+        //Tile accumulator: a fixed buffer of positive similarities that stays in L1, merged into the row heaps whenever it fills.
+        std::vector<std::tuple<uint32_t, uint32_t, float>> accumulator;
+        accumulator.reserve(accumulatorEntries);
+        auto flush = [&]() {
+            {
+                std::lock_guard<std::mutex> lock(blockMutexes[bi]);
+                for (const auto& a : accumulator) pushCandidate(std::get<0>(a), std::get<2>(a), std::get<1>(a));
+            }
+            {
+                std::lock_guard<std::mutex> lock(blockMutexes[bj]);
+                for (const auto& a : accumulator) pushCandidate(std::get<1>(a), std::get<2>(a), std::get<0>(a));
+            }
+            accumulator.clear();
+        };
+        for (size_t i = iStart; i < iEnd; ++i) {
+            for (size_t j = (bi == bj) ? i + 1 : jStart; j < jEnd; ++j) {
+                float similarity = this->similarity(store, i, j, options);
+                if (similarity <= 0.0f) continue;
+                accumulator.emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(j), similarity);
+                if (accumulator.size() == accumulatorEntries) flush();
+            }
+        }
+        flush();
+    };
+    th.runTasks(processTile, tiles.size());
+    return CompactNeighbors::fromCandidates(heaps, capacity, codec);
+}
+
+std::vector<std::vector<std::pair<uint32_t, float>>> Similarity::blockNeighbors(const CompactStore& store, size_t rowStart,
+                                                                                size_t rowEnd, int k, size_t tileRows,
+                                                                                const SimilarityOptions& options) {
+    size_t numRows = store.getRowCount();
+    size_t capacity = CompactNeighbors::capacityFor(numRows, k);
+    rowEnd = std::min(rowEnd, numRows);
+    if (tileRows == 0) tileRows = tileRowCount(store);
+
+    if (rowStart >= rowEnd) return {};
+    std::vector<std::vector<NeighborCandidate>> heaps(numRows - rowStart);
+
+    //The block is scored against one tile of later rows at a time, so the tile stays in cache for every row of the block.
+    for (size_t jStart = rowStart + 1; jStart < numRows; jStart += tileRows) {
+        size_t jEnd = std::min(jStart + tileRows, numRows);
+        for (size_t i = rowStart; i < rowEnd && i + 1 < jEnd; ++i) {
+            for (size_t j = std::max(jStart, i + 1); j < jEnd; ++j) {
+                float similarity = this->similarity(store, i, j, options);
+                if (similarity <= 0.0f) continue;
+                CompactNeighbors::pushCandidate(heaps[i - rowStart], capacity, NeighborCandidate(similarity, static_cast<uint32_t>(j)));
+                CompactNeighbors::pushCandidate(heaps[j - rowStart], capacity, NeighborCandidate(similarity, static_cast<uint32_t>(i)));
+            }
+        }
+    }
+
+    std::vector<std::vector<std::pair<uint32_t, float>>> neighbors(heaps.size());
+    for (size_t r = 0; r < heaps.size(); ++r) CompactNeighbors::sortCandidates(heaps[r], neighbors[r]);
+    return neighbors;
+}
+
 void Similarity::printSimilarityMatrix(RatingMap& matrix) {
     for (const auto& row : matrix) {
         std::cout << "[ ";
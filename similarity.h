@@ -1,15 +1,43 @@
 #ifndef SIMILARITY_H
 #define SIMILARITY_H
 
-#include "DataHash2D.h"
+#include "dataHash2D.h"
+#include "compactStore.h"
+#include "compactNeighbors.h"
 
 #include <unordered_map>
+#include <vector>
+
+//Similarity metrics available on compact stores.
+enum class SimilarityMetric {
+    Cosine,  //Cosine of the full rating vectors.
+    Pearson, //Pearson correlation over the co-rated columns.
+    Jaccard  //Co-rated columns over the union of the rated columns.
+};
+
+//Output of a similarity kernel: the similarity and the number of co-rated columns it was computed from.
+struct SimilarityScore {
+    float similarity;
+    size_t overlap;
+};
+
+/* Significance weighting applied while neighbors are selected.
+A pair with n co-rated columns is dropped if n < minOverlap and otherwise weighted by n / (n + shrinkage).
+The defaults keep the raw similarities. */
+struct SimilarityOptions {
+    SimilarityMetric metric = SimilarityMetric::Cosine;
+    float shrinkage = 0.0f;
+    size_t minOverlap = 0;
+};
 
 class Similarity {
 public:
     // Returns cosine similarity between two given vectors.
     float cosineSimilarity(const std::unordered_map<int, float>& vec1, const std::unordered_map<int, float>& vec2);
 
+    // Returns cosine similarity between two given vectors together with their co-rated count.
+    SimilarityScore cosineScore(const std::unordered_map<int, float>& vec1, const std::unordered_map<int, float>& vec2);
+
     // Returns adjusted cosine similarity between two given vectors. - Not implemented for now.
     float adjustedCosineSimilarity(const std::unordered_map<int, float>& vec1, 
                                    const std::unordered_map<int, float>& vec2, 
@@ -25,6 +53,46 @@ public:
     isMovieBased = true: Generates similarity matrix of movies.
     isMovieBased = false: Generates similarity matrix of users. */          
     RatingMap similarityMatrix(bool isMovieBased, const DataHash2D& dh);
+
+    /* Same as above with significance weighting. Only cosine is available on DataHash2D,
+    and pairs dropped by options.minOverlap are not stored in the matrix. */
+    RatingMap similarityMatrix(bool isMovieBased, const DataHash2D& dh, const SimilarityOptions& options);
+    
+    // Returns cosine similarity between two rows of a compact store, computed with a merge over the encoded rows.
+    float cosineSimilarity(const CompactStore& store, size_t row1, size_t row2);
+
+    // Returns the similarity between two rows of a compact store and their co-rated count, computed in a single merge.
+    SimilarityScore score(const CompactStore& store, size_t row1, size_t row2, SimilarityMetric metric);
+
+    // Returns the similarity between two rows of a compact store after the minimum overlap cutoff and shrinkage, 0 if cut off.
+    float similarity(const CompactStore& store, size_t row1, size_t row2, const SimilarityOptions& options);
+
+    // Applies the minimum overlap cutoff and shrinkage of options to a kernel result.
+    float weight(const SimilarityScore& score, const SimilarityOptions& options);
+
+    /* Creates the top-k neighbor lists of every row of a compact store.
+    Works directly on the encoded rows and keeps similarities quantized with the given codec.
+    Pairs cut off by options never reach the lists, and the lists are packed. */
+    CompactNeighbors neighborLists(const CompactStore& store, int k, SimilarityCodec codec = SimilarityCodec::Short,
+                                   const SimilarityOptions& options = SimilarityOptions());
+    
+    /* Same result as Similarity::neighborLists, computed tile by tile.
+    Rows are split into blocks of tileRows rows (0: sized so that two blocks fit in the L2 cache) and every
+    pair of blocks is one task of the thread pool. Only the upper triangle of block pairs is computed. */
+    CompactNeighbors tiledNeighborLists(const CompactStore& store, int k, SimilarityCodec codec = SimilarityCodec::Short,
+                                        size_t tileRows = 0, const SimilarityOptions& options = SimilarityOptions());
+
+    /* Scores every pair (i, j) with i from rowStart to rowEnd and j > i once, and returns the partial top-k neighbors
+    it gives to both rows of the pairs, for the rows rowStart to the last row (entry r is row rowStart + r). The
+    partial lists of blocks that cover all rows merge into the lists of neighborLists(). The later rows are visited in
+    tiles of tileRows rows (0: sized from the L2 cache). Used for row-block tasks that are computed away from the rest
+    of the store, such as ShardedBuild workers. */
+    std::vector<std::vector<std::pair<uint32_t, float>>> blockNeighbors(const CompactStore& store, size_t rowStart,
+                                                                         size_t rowEnd, int k, size_t tileRows = 0,
+                                                                         const SimilarityOptions& options = SimilarityOptions());
+
+    // Returns the number of rows per tile so that two tiles of the store fit in the L2 cache.
+    size_t tileRowCount(const CompactStore& store);
     
     // Prints the similarity matrix created from Similarity::similarityMatrix
     void printSimilarityMatrix(RatingMap& matrix);
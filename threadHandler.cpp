@@ -1,7 +1,22 @@
-#include "ThreadHandler.h"
+#include "threadHandler.h"
+
+#include <algorithm>
+#include <atomic>
+
+size_t ThreadHandler::defaultThreadCount = 0;
 
 ThreadHandler::ThreadHandler(size_t numThreads) {
-    this->numThreads = (numThreads <= 1) ? 2 : std::min(numThreads, static_cast<size_t>(std::thread::hardware_concurrency()));
+    size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1); //0 if the system does not report it.
+    if (numThreads == 0) numThreads = defaultThreadCount > 0 ? defaultThreadCount : hardwareThreads;
+    this->numThreads = std::min(numThreads, hardwareThreads);
+}
+
+void ThreadHandler::setDefaultThreadCount(size_t numThreads) {
+    defaultThreadCount = numThreads;
+}
+
+size_t ThreadHandler::getThreadCount() const {
+    return numThreads;
 }
 
 void ThreadHandler::runParallel(const std::function<void(size_t, size_t)>& task, size_t totalWork) {
@@ -16,6 +31,17 @@ void ThreadHandler::runParallel(const std::function<void(size_t, size_t)>& task,
     threads.clear();
 }
 
+void ThreadHandler::runTasks(const std::function<void(size_t)>& task, size_t numTasks) {
+    std::atomic<size_t> nextTask(0);
+    auto worker = [&]() {
+        for (size_t t = nextTask++; t < numTasks; t = nextTask++) task(t);
+    };
+
+    for (size_t t = 0; t < numThreads; ++t) threads.emplace_back(worker);
+    for (auto& thread : threads) if (thread.joinable()) thread.join();
+    threads.clear();
+}
+
 void ThreadHandler::lock() {
     mutex.lock();
 }
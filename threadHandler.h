@@ -1,18 +1,29 @@
 #ifndef THREADHANDLER_H
 #define THREADHANDLER_H
 
+#include <functional>
 #include <thread>
 #include <vector>
 #include <mutex>
 
 class ThreadHandler {
 public:
-	//Constructor.
-    ThreadHandler(size_t numThreads = std::thread::hardware_concurrency());
+	//Constructor. numThreads = 0: Uses the default thread count.
+    ThreadHandler(size_t numThreads = 0);
+
+    //Sets the thread count used by handlers created with numThreads = 0. 0 restores hardware concurrency.
+    static void setDefaultThreadCount(size_t numThreads);
     
+    //Returns the number of threads used by the run methods.
+    size_t getThreadCount() const;
+
     //Run threads.
     void runParallel(const std::function<void(size_t, size_t)>& task, size_t totalWork);
 
+    /* Runs numTasks independent tasks. Threads pull the next task index from a shared counter,
+    so uneven tasks are balanced between threads. */
+    void runTasks(const std::function<void(size_t)>& task, size_t numTasks);
+
     //Lock and unlock operations (w/mutex).
     void lock();
     void unlock();
@@ -21,6 +32,7 @@ private:
     size_t numThreads; 				  //Number of threads.
     std::mutex mutex; 				  //A global mutex variable for locks.
     std::vector<std::thread> threads; //List of threads.
+    static size_t defaultThreadCount; //Thread count for numThreads = 0, 0 for hardware concurrency.
 };
 
 #endif // THREADHANDLER_H